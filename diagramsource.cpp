@@ -0,0 +1,149 @@
+#include "diagramsource.h"
+
+namespace {
+const char* START_TAG = "@start";
+const char* END_TAG = "@end";
+const char* DEFAULT_END_TAG = "@enduml";
+// only these are laid out by Graphviz
+const char* GRAPHVIZ_START_TAG = "@startuml";
+const char* LAYOUT_PRAGMA = "!pragma layout";
+const char* DRAFT_LAYOUT_PRAGMA = "!pragma layout smetana\n";
+const char* UML_KIND = "uml";
+
+bool startsWithAny(const QByteArray& line, const char* const* prefixes)
+{
+    for (; *prefixes; ++prefixes) {
+        if (line.startsWith(*prefixes)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool containsAny(const QByteArray& line, const char* const* parts)
+{
+    for (; *parts; ++parts) {
+        if (line.contains(*parts)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the keywords and arrows only found in one kind of diagram
+const char* const CLASS_KEYWORDS[] = { "class ", "interface ", "abstract ", "enum ", "annotation ", 0 };
+const char* const CLASS_ARROWS[] = { "<|-", "-|>", "<|.", ".|>", "*--", "--*", "o--", "--o", 0 };
+const char* const USECASE_KEYWORDS[] = { "usecase ", "(", 0 };
+const char* const USECASE_ARROWS[] = { "> (", "-(", 0 };
+const char* const COMPONENT_KEYWORDS[] = { "component ", "node ", "artifact ", "[", 0 };
+const char* const STATE_KEYWORDS[] = { "state ", 0 };
+const char* const STATE_ARROWS[] = { "[*]", 0 };
+const char* const ACTIVITY_KEYWORDS[] = { "if (", "while (", "repeat", "fork", 0 };
+const char* const SEQUENCE_KEYWORDS[] = { "participant ", "boundary ", "control ", "entity ", "database ",
+                                          "activate ", "deactivate ", "alt ", "loop ", "autonumber", 0 };
+} // namespace {}
+
+QList<QByteArray> splitDiagrams(const QByteArray &document)
+{
+    QList<QByteArray> diagrams;
+    QByteArray current;
+    bool started = false;
+
+    foreach (const QByteArray& line, document.split('\n')) {
+        QByteArray trimmed_line = line.trimmed();
+        if (!started && trimmed_line.startsWith(START_TAG)) {
+            // drop whatever was before @start...
+            current.clear();
+            started = true;
+        }
+        if (trimmed_line.startsWith(END_TAG)) {
+            // PlantUML only recognizes the end tag at the start of the line
+            current.append(trimmed_line);
+            current.append('\n');
+            diagrams << current;
+            current.clear();
+            started = false;
+        } else {
+            current.append(line);
+            current.append('\n');
+        }
+    }
+
+    if (!current.trimmed().isEmpty()) {
+        current.append(DEFAULT_END_TAG);
+        current.append('\n');
+        diagrams << current;
+    }
+
+    return diagrams;
+}
+
+QByteArray draftDiagram(const QByteArray &diagram)
+{
+    int start_line_end = diagram.indexOf('\n');
+    if (start_line_end < 0 ||
+            !diagram.left(start_line_end).trimmed().startsWith(GRAPHVIZ_START_TAG) ||
+            diagram.contains(LAYOUT_PRAGMA)) {
+        return QByteArray();
+    }
+
+    QByteArray draft = diagram;
+    draft.insert(start_line_end + 1, DRAFT_LAYOUT_PRAGMA);
+    return draft;
+}
+
+QByteArray diagramKind(const QByteArray &diagram)
+{
+    // arrows alone say little, they decide only if nothing else does
+    bool has_arrows = false;
+
+    foreach (const QByteArray& line, diagram.split('\n')) {
+        QByteArray kind = lineKind(line, has_arrows);
+        if (!kind.isEmpty()) {
+            return kind;
+        }
+    }
+
+    return defaultDiagramKind(has_arrows);
+}
+
+QByteArray lineKind(const QByteArray &line, bool &has_arrows)
+{
+    QByteArray trimmed_line = line.trimmed().toLower();
+    if (trimmed_line.isEmpty() || trimmed_line.startsWith('\'')) {
+        return QByteArray();
+    }
+    if (trimmed_line.startsWith(START_TAG)) {
+        QByteArray tag = trimmed_line.mid(qstrlen(START_TAG)).split(' ').first();
+        return tag != UML_KIND ? tag : QByteArray();
+    }
+
+    if (startsWithAny(trimmed_line, CLASS_KEYWORDS) || containsAny(trimmed_line, CLASS_ARROWS)) {
+        return "class";
+    }
+    if (startsWithAny(trimmed_line, STATE_KEYWORDS) || containsAny(trimmed_line, STATE_ARROWS)) {
+        return "state";
+    }
+    if (startsWithAny(trimmed_line, USECASE_KEYWORDS) || containsAny(trimmed_line, USECASE_ARROWS)) {
+        return "usecase";
+    }
+    if (startsWithAny(trimmed_line, COMPONENT_KEYWORDS)) {
+        return "component";
+    }
+    if (trimmed_line == "start" || trimmed_line == "stop" || startsWithAny(trimmed_line, ACTIVITY_KEYWORDS) ||
+            (trimmed_line.startsWith(':') && trimmed_line.endsWith(';'))) {
+        return "activity";
+    }
+    if (startsWithAny(trimmed_line, SEQUENCE_KEYWORDS)) {
+        return "sequence";
+    }
+    if (trimmed_line.contains("->") || trimmed_line.contains("<-")) {
+        has_arrows = true;
+    }
+    return QByteArray();
+}
+
+QByteArray defaultDiagramKind(bool has_arrows)
+{
+    return has_arrows ? "sequence" : UML_KIND;
+}
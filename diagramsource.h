@@ -0,0 +1,30 @@
+#ifndef DIAGRAMSOURCE_H
+#define DIAGRAMSOURCE_H
+
+#include <QByteArray>
+#include <QList>
+
+// Splits a document in the diagrams PlantUML's -pipe mode renders one by one.
+// Each chunk starts at its @start... line and ends with an @end... line. Text
+// that is not closed by an @end... line gets an "@enduml" appended, so a
+// long-lived PlantUML process never waits for input that will not come.
+QList<QByteArray> splitDiagrams(const QByteArray& document);
+
+// The diagram laid out by PlantUML's own layout engine (Smetana) instead of
+// Graphviz: faster for large diagrams, but not as good. Empty for diagrams
+// which don't use Graphviz, or choose their layout engine themselves.
+QByteArray draftDiagram(const QByteArray& diagram);
+
+// A guess of the kind of a diagram from its keywords and arrows: "class",
+// "usecase", "component", "state", "activity" or "sequence" for the @startuml
+// ones ("uml" if nothing gives it away), the name in the start tag for the
+// others ("mindmap" for @startmindmap).
+QByteArray diagramKind(const QByteArray& diagram);
+
+// The kind a single line of a diagram gives away, empty if it says nothing;
+// has_arrows is set when it has arrows. diagramKind() is the first kind given
+// away by its lines, or else defaultDiagramKind().
+QByteArray lineKind(const QByteArray& line, bool& has_arrows);
+QByteArray defaultDiagramKind(bool has_arrows);
+
+#endif // DIAGRAMSOURCE_H
@@ -0,0 +1,455 @@
+#include "documentdigest.h"
+#include "documenthash.h"
+#include "diagramsource.h"
+#include "includeresolver.h"
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QtEndian>
+
+//------------------------------------------------------------------------------
+
+namespace {
+const char* START_TAG = "@start";
+const char* END_TAG = "@end";
+const char* DEFAULT_END_TAG = "@enduml";
+
+// the lines counted in each subtree
+enum LineFlag {
+    START_LINE,
+    END_LINE,
+    CONTENT_LINE, //< not blank
+    INCLUDE_LINE,
+    ARROW_LINE,
+    FLAG_COUNT
+};
+
+// The lines are hashed twice, modulo the prime 2^61 - 1 with two different
+// bases, for 122 bits in all.
+const int LANES = 2;
+const quint64 MOD = (Q_UINT64_C(1) << 61) - 1;
+const quint64 BASES[LANES] = { Q_UINT64_C(0x1f3d5b79a1c2e4f), Q_UINT64_C(0x0b4e1d3c5a7f9e3) };
+
+const int DIGEST_SIZE = LANES * 8 + 4 + 1;
+
+// a * b modulo 2^61 - 1, for a and b below it, without 128 bit integers
+quint64 mulMod(quint64 a, quint64 b)
+{
+    const quint64 a_low = a & 0xffffffff;
+    const quint64 a_high = a >> 32;
+    const quint64 b_low = b & 0xffffffff;
+    const quint64 b_high = b >> 32;
+    const quint64 low = a_low * b_low;
+    const quint64 middle = a_low * b_high + a_high * b_low;
+    const quint64 high = a_high * b_high;
+    quint64 result = (low & MOD) + (low >> 61) + (high << 3) + (middle >> 29) + ((middle << 35) >> 3) + 1;
+    result = (result & MOD) + (result >> 61);
+    result = (result & MOD) + (result >> 61);
+    return result - 1;
+}
+
+quint64 addMod(quint64 a, quint64 b)
+{
+    const quint64 sum = a + b;
+    return sum >= MOD ? sum - MOD : sum;
+}
+
+quint32 nextPriority(quint32& seed)
+{
+    // xorshift, the priorities only have to be spread evenly
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+struct DocumentLines::Node
+{
+    QByteArray line;
+    quint32 priority;
+    Node* left;
+    Node* right;
+
+    // of this line alone
+    quint64 symbol[LANES]; //< never 0, or blank lines would vanish from the hash
+    bool flags[FLAG_COUNT];
+    QByteArray kind;
+
+    // of the whole subtree
+    int size;
+    quint64 hash[LANES];
+    quint64 power[LANES]; //< BASES[lane]^size
+    int counts[FLAG_COUNT];
+    QByteArray firstKind;
+};
+
+struct DocumentLines::Summary
+{
+    int size;
+    quint64 hash[LANES];
+    int counts[FLAG_COUNT];
+    QByteArray firstKind;
+};
+
+//------------------------------------------------------------------------------
+
+DocumentLines::DocumentLines()
+    : m_root(0)
+    , m_seed(2463534242u)
+{
+}
+
+DocumentLines::~DocumentLines()
+{
+    destroy(m_root);
+}
+
+int DocumentLines::size() const
+{
+    return m_root ? m_root->size : 0;
+}
+
+void DocumentLines::replace(int first, int count, const QList<QByteArray> &lines)
+{
+    Node* before;
+    Node* rest;
+    Node* removed;
+    Node* after;
+    split(m_root, first, before, rest);
+    split(rest, count, removed, after);
+    destroy(removed);
+
+    Node* added = 0;
+    foreach (const QByteArray& line, lines) {
+        added = merge(added, newNode(line));
+    }
+    m_root = merge(merge(before, added), after);
+}
+
+void DocumentLines::clear()
+{
+    destroy(m_root);
+    m_root = 0;
+}
+
+bool DocumentLines::isBlank() const
+{
+    return !m_root || m_root->counts[CONTENT_LINE] == 0;
+}
+
+QList<DocumentLines::Diagram> DocumentLines::diagrams()
+{
+    QList<Diagram> diagrams;
+    if (!m_root) {
+        return diagrams;
+    }
+
+    // each @end... line closes a diagram, which starts at the first
+    // @start... line after the previous one, or right after it without any
+    const int start_count = m_root->counts[START_LINE];
+    const int end_count = m_root->counts[END_LINE];
+    int begin = 0;
+    for (int i = 0; i <= end_count; ++i) {
+        const bool closed = i < end_count;
+        const int end = closed ? nthLine(i, END_LINE) + 1 : size();
+        int first = begin;
+        const int starts_before = countBefore(begin, START_LINE);
+        if (starts_before < start_count) {
+            const int start = nthLine(starts_before, START_LINE);
+            if (start < end) {
+                first = start;
+            }
+        }
+        begin = end;
+
+        const Summary lines = summary(first, end - first);
+        if (!closed && lines.counts[CONTENT_LINE] == 0) {
+            continue; // nothing after the last diagram
+        }
+
+        Diagram diagram;
+        diagram.firstLine = first;
+        diagram.lineCount = end - first;
+        diagram.closed = closed;
+        diagram.hasIncludes = lines.counts[INCLUDE_LINE] > 0;
+        diagram.kind = lines.firstKind.isEmpty() ? defaultDiagramKind(lines.counts[ARROW_LINE] > 0) : lines.firstKind;
+        diagram.digest = QByteArray(DIGEST_SIZE, Qt::Uninitialized);
+        uchar* digest = reinterpret_cast<uchar*>(diagram.digest.data());
+        for (int lane = 0; lane < LANES; ++lane) {
+            qToLittleEndian(lines.hash[lane], digest + lane * 8);
+        }
+        qToLittleEndian(quint32(lines.size), digest + LANES * 8);
+        digest[DIGEST_SIZE - 1] = closed;
+        diagrams << diagram;
+    }
+    return diagrams;
+}
+
+QByteArray DocumentLines::text(const DocumentLines::Diagram &diagram)
+{
+    Node* before;
+    Node* rest;
+    Node* middle;
+    Node* after;
+    split(m_root, diagram.firstLine, before, rest);
+    split(rest, diagram.lineCount, middle, after);
+    QList<QByteArray> lines;
+    appendLines(middle, lines);
+    m_root = merge(merge(before, middle), after);
+
+    QByteArray text;
+    for (int i = 0; i < lines.size(); ++i) {
+        // PlantUML only recognizes the end tag at the start of the line
+        text.append(diagram.closed && i == lines.size() - 1 ? lines[i].trimmed() : lines[i]);
+        text.append('\n');
+    }
+    if (!diagram.closed) {
+        text.append(DEFAULT_END_TAG);
+        text.append('\n');
+    }
+    return text;
+}
+
+DocumentLines::Summary DocumentLines::summary(int first, int count)
+{
+    Node* before;
+    Node* rest;
+    Node* middle;
+    Node* after;
+    split(m_root, first, before, rest);
+    split(rest, count, middle, after);
+
+    Summary summary;
+    summary.size = middle ? middle->size : 0;
+    for (int lane = 0; lane < LANES; ++lane) {
+        summary.hash[lane] = middle ? middle->hash[lane] : 0;
+    }
+    for (int flag = 0; flag < FLAG_COUNT; ++flag) {
+        summary.counts[flag] = middle ? middle->counts[flag] : 0;
+    }
+    if (middle) {
+        summary.firstKind = middle->firstKind;
+    }
+
+    m_root = merge(merge(before, middle), after);
+    return summary;
+}
+
+int DocumentLines::countBefore(int index, int flag) const
+{
+    int count = 0;
+    const Node* node = m_root;
+    while (node) {
+        const int left_size = node->left ? node->left->size : 0;
+        if (index <= left_size) {
+            node = node->left;
+        } else {
+            count += (node->left ? node->left->counts[flag] : 0) + node->flags[flag];
+            index -= left_size + 1;
+            node = node->right;
+        }
+    }
+    return count;
+}
+
+int DocumentLines::nthLine(int n, int flag) const
+{
+    int index = 0;
+    const Node* node = m_root;
+    while (node) {
+        const int left_count = node->left ? node->left->counts[flag] : 0;
+        if (n < left_count) {
+            node = node->left;
+            continue;
+        }
+        n -= left_count;
+        const int left_size = node->left ? node->left->size : 0;
+        if (node->flags[flag]) {
+            if (n == 0) {
+                return index + left_size;
+            }
+            --n;
+        }
+        index += left_size + 1;
+        node = node->right;
+    }
+    return -1;
+}
+
+DocumentLines::Node *DocumentLines::newNode(const QByteArray &line)
+{
+    Node* node = new Node;
+    node->line = line;
+    node->priority = nextPriority(m_seed);
+    node->left = 0;
+    node->right = 0;
+
+    FastDocumentHash hash;
+    hash.addData(line);
+    const QByteArray line_hash = hash.result();
+    for (int lane = 0; lane < LANES; ++lane) {
+        const quint64 word = qFromLittleEndian<quint64>(reinterpret_cast<const uchar*>(line_hash.constData()) + lane * 8);
+        node->symbol[lane] = word % (MOD - 1) + 1;
+    }
+
+    const QByteArray trimmed_line = line.trimmed();
+    bool has_arrows = false;
+    node->kind = lineKind(line, has_arrows);
+    node->flags[START_LINE] = trimmed_line.startsWith(START_TAG);
+    node->flags[END_LINE] = trimmed_line.startsWith(END_TAG);
+    node->flags[CONTENT_LINE] = !trimmed_line.isEmpty();
+    node->flags[INCLUDE_LINE] = !IncludeResolver::includePaths(line).isEmpty();
+    node->flags[ARROW_LINE] = has_arrows;
+
+    update(node);
+    return node;
+}
+
+void DocumentLines::update(DocumentLines::Node *node)
+{
+    const Node* left = node->left;
+    const Node* right = node->right;
+
+    node->size = 1 + (left ? left->size : 0) + (right ? right->size : 0);
+    for (int lane = 0; lane < LANES; ++lane) {
+        // hash(a + b) = hash(a) * base^size(b) + hash(b)
+        quint64 hash = node->symbol[lane];
+        quint64 power = BASES[lane];
+        if (left) {
+            hash = addMod(mulMod(left->hash[lane], BASES[lane]), hash);
+            power = mulMod(left->power[lane], power);
+        }
+        if (right) {
+            hash = addMod(mulMod(hash, right->power[lane]), right->hash[lane]);
+            power = mulMod(power, right->power[lane]);
+        }
+        node->hash[lane] = hash;
+        node->power[lane] = power;
+    }
+    for (int flag = 0; flag < FLAG_COUNT; ++flag) {
+        node->counts[flag] = node->flags[flag] + (left ? left->counts[flag] : 0) + (right ? right->counts[flag] : 0);
+    }
+    if (left && !left->firstKind.isEmpty()) {
+        node->firstKind = left->firstKind;
+    } else if (!node->kind.isEmpty()) {
+        node->firstKind = node->kind;
+    } else {
+        node->firstKind = right ? right->firstKind : QByteArray();
+    }
+}
+
+void DocumentLines::split(DocumentLines::Node *node, int count, DocumentLines::Node *&left, DocumentLines::Node *&right)
+{
+    // the first count lines go left
+    if (!node) {
+        left = 0;
+        right = 0;
+        return;
+    }
+    const int left_size = node->left ? node->left->size : 0;
+    if (count <= left_size) {
+        split(node->left, count, left, node->left);
+        right = node;
+    } else {
+        split(node->right, count - left_size - 1, node->right, right);
+        left = node;
+    }
+    update(node);
+}
+
+DocumentLines::Node *DocumentLines::merge(DocumentLines::Node *left, DocumentLines::Node *right)
+{
+    if (!left) {
+        return right;
+    }
+    if (!right) {
+        return left;
+    }
+    if (left->priority > right->priority) {
+        left->right = merge(left->right, right);
+        update(left);
+        return left;
+    }
+    right->left = merge(left, right->left);
+    update(right);
+    return right;
+}
+
+void DocumentLines::destroy(DocumentLines::Node *node)
+{
+    if (node) {
+        destroy(node->left);
+        destroy(node->right);
+        delete node;
+    }
+}
+
+void DocumentLines::appendLines(const DocumentLines::Node *node, QList<QByteArray> &lines)
+{
+    if (node) {
+        appendLines(node->left, lines);
+        lines << node->line;
+        appendLines(node->right, lines);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+DocumentDigest::DocumentDigest(QTextDocument *document, QObject *parent)
+    : QObject(parent)
+    , m_document(document)
+{
+    reload();
+    connect(m_document, SIGNAL(contentsChange(int,int,int)), this, SLOT(onContentsChange(int,int,int)));
+}
+
+void DocumentDigest::onContentsChange(int position, int chars_removed, int chars_added)
+{
+    Q_UNUSED(chars_removed);
+
+    // The blocks before the one where the change starts, and those after the
+    // one where it ends, are the same as before. The ones between replace
+    // all the lines the document had between them.
+    QTextBlock first = m_document->findBlock(position);
+    QTextBlock last = m_document->findBlock(position + chars_added);
+    if (!first.isValid()) {
+        first = m_document->lastBlock();
+    }
+    if (!last.isValid()) {
+        last = m_document->lastBlock();
+    }
+    const int first_line = first.blockNumber();
+    const int last_line = last.blockNumber();
+    const int removed = m_lines.size() - (m_document->blockCount() - last_line - 1) - first_line;
+    if (first_line > m_lines.size() || removed < 0) {
+        reload(); // not a change of the text it was told about
+        return;
+    }
+    m_lines.replace(first_line, removed, blockLines(first_line, last_line));
+}
+
+void DocumentDigest::reload()
+{
+    m_lines.clear();
+    m_lines.replace(0, 0, blockLines(0, m_document->blockCount() - 1));
+}
+
+QList<QByteArray> DocumentDigest::blockLines(int first, int last) const
+{
+    QList<QByteArray> lines;
+    for (QTextBlock block = m_document->findBlockByNumber(first);
+         block.isValid() && block.blockNumber() <= last;
+         block = block.next()) {
+        // as toPlainText() has them; the tags after a soft line break are
+        // only found at the next block though
+        QString text = block.text();
+        text.replace(QChar::Nbsp, QLatin1Char(' '));
+        text.replace(QChar::LineSeparator, QLatin1Char('\n'));
+        lines << text.toUtf8();
+    }
+    return lines;
+}
+
+//------------------------------------------------------------------------------
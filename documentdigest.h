@@ -0,0 +1,89 @@
+#ifndef DOCUMENTDIGEST_H
+#define DOCUMENTDIGEST_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+
+class QTextDocument;
+
+//------------------------------------------------------------------------------
+
+// The lines of a document, and what the cache keys of its diagrams need from
+// them, in a balanced tree ordered by line number (a treap). Each subtree
+// keeps a polynomial hash of its lines and counts of the interesting ones, so
+// replacing a line, finding the lines of a diagram or hashing them all cost
+// O(log n) whatever the size of the document. The diagrams are split like
+// splitDiagrams() does, by the @start... and @end... lines.
+class DocumentLines
+{
+public:
+    struct Diagram
+    {
+        int firstLine;
+        int lineCount;
+        bool closed; //< by an @end... line, or else "@enduml" is appended
+        bool hasIncludes; //< its key depends on other files too
+        QByteArray kind; //< as diagramKind() says
+        QByteArray digest; //< changes whenever one of its lines does
+    };
+
+    DocumentLines();
+    ~DocumentLines();
+
+    int size() const;
+    // the count lines from first on are replaced by these ones
+    void replace(int first, int count, const QList<QByteArray>& lines);
+    void clear();
+
+    // no text but whitespace
+    bool isBlank() const;
+    QList<Diagram> diagrams();
+    // the text given to PlantUML, the only part walking all its lines
+    QByteArray text(const Diagram& diagram);
+
+private:
+    struct Node;
+    struct Summary;
+
+    Summary summary(int first, int count);
+    int countBefore(int index, int flag) const;
+    int nthLine(int n, int flag) const;
+    Node* newNode(const QByteArray& line);
+
+    static void update(Node* node);
+    static void split(Node* node, int count, Node*& left, Node*& right);
+    static Node* merge(Node* left, Node* right);
+    static void destroy(Node* node);
+    static void appendLines(const Node* node, QList<QByteArray>& lines);
+
+    Node* m_root;
+    quint32 m_seed; //< of the priorities
+};
+
+//------------------------------------------------------------------------------
+
+// Keeps the DocumentLines of a QTextDocument as it is edited, reading again
+// only the blocks contentsChange() says were touched.
+class DocumentDigest : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DocumentDigest(QTextDocument* document, QObject* parent = 0);
+
+    DocumentLines& lines() { return m_lines; }
+
+private slots:
+    void onContentsChange(int position, int chars_removed, int chars_added);
+
+private:
+    void reload();
+    QList<QByteArray> blockLines(int first, int last) const;
+
+    QTextDocument* m_document;
+    DocumentLines m_lines;
+};
+
+//------------------------------------------------------------------------------
+
+#endif // DOCUMENTDIGEST_H
@@ -0,0 +1,184 @@
+#include "documenthash.h"
+#include <QtEndian>
+#include <cstring>
+
+//------------------------------------------------------------------------------
+
+namespace {
+const QByteArray MD5_NAME = "md5";
+const QByteArray FAST_NAME = "murmur3-128";
+
+const quint64 C1 = Q_UINT64_C(0x87c37b91114253d5);
+const quint64 C2 = Q_UINT64_C(0x4cf5ad432745937f);
+const int BLOCK_SIZE = 16;
+
+inline quint64 rotl(quint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline quint64 fmix(quint64 k)
+{
+    k ^= k >> 33;
+    k *= Q_UINT64_C(0xff51afd7ed558ccd);
+    k ^= k >> 33;
+    k *= Q_UINT64_C(0xc4ceb9fe1a85ec53);
+    k ^= k >> 33;
+    return k;
+}
+
+// the bytes are read the same on any machine
+inline quint64 readWord(const uchar* bytes)
+{
+    quint64 word;
+    std::memcpy(&word, bytes, sizeof(word));
+    return qFromLittleEndian(word);
+}
+
+inline void writeWord(quint64 word, uchar* bytes)
+{
+    word = qToLittleEndian(word);
+    std::memcpy(bytes, &word, sizeof(word));
+}
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+DocumentHash* DocumentHash::create()
+{
+    return new FastDocumentHash;
+}
+
+DocumentHash* DocumentHash::create(const QByteArray &name)
+{
+    if (name == FAST_NAME) {
+        return new FastDocumentHash;
+    }
+    if (name == MD5_NAME) {
+        return new Md5DocumentHash;
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+Md5DocumentHash::Md5DocumentHash()
+    : m_hash(QCryptographicHash::Md5)
+{
+}
+
+QByteArray Md5DocumentHash::name() const
+{
+    return MD5_NAME;
+}
+
+void Md5DocumentHash::reset()
+{
+    m_hash.reset();
+}
+
+void Md5DocumentHash::addData(const char *data, int length)
+{
+    m_hash.addData(data, length);
+}
+
+QByteArray Md5DocumentHash::result()
+{
+    return m_hash.result();
+}
+
+//------------------------------------------------------------------------------
+
+FastDocumentHash::FastDocumentHash()
+{
+    reset();
+}
+
+QByteArray FastDocumentHash::name() const
+{
+    return FAST_NAME;
+}
+
+void FastDocumentHash::reset()
+{
+    m_h1 = 0;
+    m_h2 = 0;
+    m_length = 0;
+    m_tailLength = 0;
+}
+
+void FastDocumentHash::addData(const char *data, int length)
+{
+    const uchar* bytes = reinterpret_cast<const uchar*>(data);
+    m_length += length;
+
+    if (m_tailLength > 0) {
+        const int missing = qMin(BLOCK_SIZE - m_tailLength, length);
+        std::memcpy(m_tail + m_tailLength, bytes, missing);
+        m_tailLength += missing;
+        bytes += missing;
+        length -= missing;
+        if (m_tailLength < BLOCK_SIZE) {
+            return;
+        }
+        addBlock(m_tail);
+        m_tailLength = 0;
+    }
+
+    // most of the text goes straight from the buffer it was given in
+    for (; length >= BLOCK_SIZE; bytes += BLOCK_SIZE, length -= BLOCK_SIZE) {
+        addBlock(bytes);
+    }
+
+    std::memcpy(m_tail, bytes, length);
+    m_tailLength = length;
+}
+
+QByteArray FastDocumentHash::result()
+{
+    quint64 h1 = m_h1;
+    quint64 h2 = m_h2;
+
+    quint64 k1 = 0;
+    quint64 k2 = 0;
+    for (int i = m_tailLength - 1; i >= 8; --i) {
+        k2 = (k2 << 8) | m_tail[i];
+    }
+    for (int i = qMin(m_tailLength, 8) - 1; i >= 0; --i) {
+        k1 = (k1 << 8) | m_tail[i];
+    }
+    if (m_tailLength > 8) {
+        k2 *= C2; k2 = rotl(k2, 33); k2 *= C1; h2 ^= k2;
+    }
+    if (m_tailLength > 0) {
+        k1 *= C1; k1 = rotl(k1, 31); k1 *= C2; h1 ^= k1;
+    }
+
+    h1 ^= m_length;
+    h2 ^= m_length;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix(h1);
+    h2 = fmix(h2);
+    h1 += h2;
+    h2 += h1;
+
+    QByteArray result(BLOCK_SIZE, Qt::Uninitialized);
+    writeWord(h1, reinterpret_cast<uchar*>(result.data()));
+    writeWord(h2, reinterpret_cast<uchar*>(result.data()) + 8);
+    return result;
+}
+
+void FastDocumentHash::addBlock(const uchar *block)
+{
+    quint64 k1 = readWord(block);
+    quint64 k2 = readWord(block + 8);
+
+    k1 *= C1; k1 = rotl(k1, 31); k1 *= C2; m_h1 ^= k1;
+    m_h1 = rotl(m_h1, 27); m_h1 += m_h2; m_h1 = m_h1 * 5 + 0x52dce729;
+
+    k2 *= C2; k2 = rotl(k2, 33); k2 *= C1; m_h2 ^= k2;
+    m_h2 = rotl(m_h2, 31); m_h2 += m_h1; m_h2 = m_h2 * 5 + 0x38495ab5;
+}
+
+//------------------------------------------------------------------------------
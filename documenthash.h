@@ -0,0 +1,75 @@
+#ifndef DOCUMENTHASH_H
+#define DOCUMENTHASH_H
+
+#include <QByteArray>
+#include <QCryptographicHash>
+
+//------------------------------------------------------------------------------
+
+// Hashes the text of a diagram into the 16 bytes of its cache key. The name
+// of the hash is part of the generation of the cache, so that keys made by
+// another hash are never mistaken for these ones.
+class DocumentHash
+{
+public:
+    virtual ~DocumentHash() {}
+
+    virtual QByteArray name() const = 0;
+    virtual void reset() = 0;
+    virtual void addData(const char* data, int length) = 0;
+    void addData(const QByteArray& data) { addData(data.constData(), data.size()); }
+    virtual QByteArray result() = 0;
+
+    // the one the editor uses
+    static DocumentHash* create();
+    // 0 for an unknown name
+    static DocumentHash* create(const QByteArray& name);
+};
+
+//------------------------------------------------------------------------------
+
+// The one the keys were made with at first.
+class Md5DocumentHash : public DocumentHash
+{
+public:
+    Md5DocumentHash();
+
+    virtual QByteArray name() const;
+    virtual void reset();
+    using DocumentHash::addData;
+    virtual void addData(const char* data, int length);
+    virtual QByteArray result();
+
+private:
+    QCryptographicHash m_hash;
+};
+
+//------------------------------------------------------------------------------
+
+// MurmurHash3 (the x64 128 bit variant): a fast non-cryptographic hash,
+// eating the text 16 bytes at a time with a couple of multiplications per 8
+// bytes. Good enough for the keys of a cache, where nobody forges collisions.
+class FastDocumentHash : public DocumentHash
+{
+public:
+    FastDocumentHash();
+
+    virtual QByteArray name() const;
+    virtual void reset();
+    using DocumentHash::addData;
+    virtual void addData(const char* data, int length);
+    virtual QByteArray result();
+
+private:
+    void addBlock(const uchar* block);
+
+    quint64 m_h1;
+    quint64 m_h2;
+    quint64 m_length; //< in bytes, so far
+    uchar m_tail[16]; //< the bytes of the block not complete yet
+    int m_tailLength;
+};
+
+//------------------------------------------------------------------------------
+
+#endif // DOCUMENTHASH_H
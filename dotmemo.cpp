@@ -0,0 +1,228 @@
+#include "dotmemo.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QCoreApplication>
+#include <QProcess>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <cstdio>
+
+//------------------------------------------------------------------------------
+
+namespace {
+const char* DOT_PATH_VARIABLE = "PLANTUMLQEDITOR_DOT";
+const char* MEMO_PATH_VARIABLE = "PLANTUMLQEDITOR_DOT_MEMO";
+const char* SESSION_VARIABLE = "PLANTUMLQEDITOR_DOT_SESSION";
+
+// appended one byte per event, which is atomic for concurrent shims, and
+// followed by "-<session>"
+const QString HITS_FILE_NAME = "hits";
+const QString MISSES_FILE_NAME = "misses";
+const QString LAYOUT_SUFFIX = ".out";
+const QString PARTIAL_LAYOUT_SUFFIX = ".part";
+
+// Only the runs reading the graph on stdin and writing the layout on stdout
+// are memoized: the other ones (dot -V from PlantUML's version check) may
+// not even have an input to read.
+bool isMemoizable(const QStringList& arguments)
+{
+    foreach (const QString& argument, arguments) {
+        if (!argument.startsWith('-') || argument.startsWith("-V") || argument.startsWith("-?") ||
+                argument.startsWith("-o")) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// runs the real dot on the standard channels of the shim
+int runForwarded(const QString& dot_path, const QStringList& arguments)
+{
+    QProcess dot;
+    dot.setProcessChannelMode(QProcess::ForwardedChannels);
+    dot.start(dot_path, arguments);
+    if (!dot.waitForStarted(-1)) {
+        fprintf(stderr, "%s: %s\n", qPrintable(dot_path), qPrintable(dot.errorString()));
+        return 1;
+    }
+    dot.closeWriteChannel();
+    dot.waitForFinished(-1);
+    return dot.exitStatus() == QProcess::NormalExit ? dot.exitCode() : 1;
+}
+
+int runCaptured(const QString& dot_path, const QStringList& arguments, const QByteArray& input,
+                QByteArray& output)
+{
+    QProcess dot;
+    dot.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    dot.start(dot_path, arguments);
+    if (!dot.waitForStarted(-1)) {
+        fprintf(stderr, "%s: %s\n", qPrintable(dot_path), qPrintable(dot.errorString()));
+        return 1;
+    }
+    dot.write(input);
+    dot.closeWriteChannel();
+    dot.waitForFinished(-1);
+    output = dot.readAllStandardOutput();
+    return dot.exitStatus() == QProcess::NormalExit ? dot.exitCode() : 1;
+}
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+DotMemo::DotMemo(const QString &path, const QString &session)
+    : m_path(path)
+    , m_session(session)
+{
+}
+
+QString DotMemo::key(const QString &dot_path, const QStringList &arguments, const QByteArray &input) const
+{
+    // another dot may lay the same graph out differently
+    const QFileInfo dot_info(dot_path);
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(dot_path.toUtf8());
+    hash.addData(QByteArray::number(dot_info.size()));
+    hash.addData(dot_info.lastModified().toString(Qt::ISODate).toUtf8());
+    hash.addData(arguments.join("\n").toUtf8());
+    hash.addData("\0", 1);
+    hash.addData(input);
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+bool DotMemo::find(const QString &key, QByteArray &output) const
+{
+    QFile file(QDir(m_path).absoluteFilePath(key + LAYOUT_SUFFIX));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    output = file.readAll();
+    return true;
+}
+
+void DotMemo::store(const QString &key, const QByteArray &output)
+{
+    QDir dir(m_path);
+    dir.mkpath(m_path);
+    // written aside and renamed, a concurrent shim never reads half of it
+    const QString partial_path = dir.absoluteFilePath(QString("%1-%2%3")
+                                                      .arg(key)
+                                                      .arg(QCoreApplication::applicationPid())
+                                                      .arg(PARTIAL_LAYOUT_SUFFIX));
+    QFile file(partial_path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(output) != output.size()) {
+        file.remove();
+        return;
+    }
+    file.close();
+    if (!QFile::rename(partial_path, dir.absoluteFilePath(key + LAYOUT_SUFFIX))) {
+        QFile::remove(partial_path); // stored by another shim meanwhile
+    }
+}
+
+void DotMemo::countHit()
+{
+    count(HITS_FILE_NAME);
+}
+
+void DotMemo::countMiss()
+{
+    count(MISSES_FILE_NAME);
+}
+
+qint64 DotMemo::hits() const
+{
+    return countOf(HITS_FILE_NAME);
+}
+
+qint64 DotMemo::misses() const
+{
+    return countOf(MISSES_FILE_NAME);
+}
+
+void DotMemo::resetCounts()
+{
+    QFile::remove(countPath(HITS_FILE_NAME));
+    QFile::remove(countPath(MISSES_FILE_NAME));
+}
+
+void DotMemo::prune(qint64 max_size, const QDateTime &stored_before)
+{
+    QDir dir(m_path);
+    qint64 size = 0;
+    // newest first
+    foreach (const QFileInfo& info, dir.entryInfoList(QStringList() << "*" + LAYOUT_SUFFIX, QDir::Files, QDir::Time)) {
+        size += info.size();
+        if (size > max_size && info.lastModified() < stored_before) {
+            dir.remove(info.fileName());
+        }
+    }
+}
+
+void DotMemo::count(const QString &name)
+{
+    QDir().mkpath(m_path);
+    QFile file(countPath(name));
+    if (file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        file.write("+", 1);
+    }
+}
+
+qint64 DotMemo::countOf(const QString &name) const
+{
+    return QFileInfo(countPath(name)).size();
+}
+
+QString DotMemo::countPath(const QString &name) const
+{
+    return QDir(m_path).absoluteFilePath(m_session.isEmpty() ? name : QString("%1-%2").arg(name).arg(m_session));
+}
+
+QStringList DotMemo::shimEnvironment(const QString &dot_path, const QString &memo_path, const QString &session)
+{
+    return QStringList()
+            << QString("%1=%2").arg(DOT_PATH_VARIABLE).arg(dot_path)
+            << QString("%1=%2").arg(MEMO_PATH_VARIABLE).arg(memo_path)
+            << QString("%1=%2").arg(SESSION_VARIABLE).arg(session);
+}
+
+bool DotMemo::isShim()
+{
+    return !qgetenv(MEMO_PATH_VARIABLE).isEmpty();
+}
+
+int DotMemo::runShim(const QStringList &arguments)
+{
+    const QString dot_path = QString::fromLocal8Bit(qgetenv(DOT_PATH_VARIABLE));
+    if (!isMemoizable(arguments)) {
+        return runForwarded(dot_path, arguments);
+    }
+
+    QFile in;
+    in.open(stdin, QIODevice::ReadOnly);
+    const QByteArray input = in.readAll();
+
+    DotMemo memo(QString::fromLocal8Bit(qgetenv(MEMO_PATH_VARIABLE)), QString::fromLocal8Bit(qgetenv(SESSION_VARIABLE)));
+    const QString memo_key = memo.key(dot_path, arguments, input);
+    QByteArray output;
+    int exit_code = 0;
+    if (memo.find(memo_key, output)) {
+        memo.countHit();
+    } else {
+        exit_code = runCaptured(dot_path, arguments, input, output);
+        memo.countMiss();
+        // the errors of dot aren't worth keeping, it may do better next time
+        if (exit_code == 0 && !output.isEmpty()) {
+            memo.store(memo_key, output);
+        }
+    }
+
+    QFile out;
+    out.open(stdout, QIODevice::WriteOnly);
+    out.write(output);
+    out.close();
+    return exit_code;
+}
+
+//------------------------------------------------------------------------------
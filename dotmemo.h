@@ -0,0 +1,63 @@
+#ifndef DOTMEMO_H
+#define DOTMEMO_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QDateTime>
+
+//------------------------------------------------------------------------------
+
+// The layouts Graphviz's dot already computed, in a directory of their own.
+// PlantUML runs dot once per diagram, and an edit of a label or a note often
+// gives it the same DOT input as before: the editor is then given to PlantUML
+// as its dot, and runs as a shim (see runShim()) which answers from the memo
+// and only runs the real dot for the inputs it hasn't seen. The shims count
+// their hits and misses in the directory, for the editor to show: in files of
+// the session of the editor which started them, as several editors may share
+// the directory.
+class DotMemo
+{
+public:
+    explicit DotMemo(const QString& path, const QString& session = QString());
+
+    const QString& path() const { return m_path; }
+    const QString& session() const { return m_session; }
+
+    // of the output of this dot for these arguments and this input
+    QString key(const QString& dot_path, const QStringList& arguments, const QByteArray& input) const;
+    bool find(const QString& key, QByteArray& output) const;
+    void store(const QString& key, const QByteArray& output);
+
+    void countHit();
+    void countMiss();
+    qint64 hits() const;
+    qint64 misses() const;
+    void resetCounts(); //< of this session only
+
+    // Removes the least recently stored layouts past this size, in bytes, of
+    // those stored before this time: the newer ones may be in use by another
+    // editor.
+    void prune(qint64 max_size, const QDateTime& stored_before);
+
+    // The environment that makes the editor run as a shim for this dot (just
+    // "dot" to find it in the PATH), with its memo in this directory and its
+    // counts in those of this session.
+    static QStringList shimEnvironment(const QString& dot_path, const QString& memo_path, const QString& session);
+    // true if this process was started by PlantUML as its dot
+    static bool isShim();
+    // does what dot would do with these arguments, returns its exit code
+    static int runShim(const QStringList& arguments);
+
+private:
+    void count(const QString& name);
+    qint64 countOf(const QString& name) const;
+    QString countPath(const QString& name) const;
+
+    QString m_path;
+    QString m_session;
+};
+
+//------------------------------------------------------------------------------
+
+#endif // DOTMEMO_H
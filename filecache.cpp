@@ -1,31 +1,165 @@
 #include "filecache.h"
 #include <QDir>
+#include <QTimer>
 #include <QDebug>
+#include <algorithm>
 
 //------------------------------------------------------------------------------
 
 namespace {
+const QString PARTIAL_ITEM_SUFFIX = ".part";
+const QChar GENERATION_SEPARATOR = '-';
+// how the stale items are removed: a few at a time, to keep out of the way
+const int COLLECT_INTERVAL = 200; // in miliseconds
+const int COLLECT_BATCH_SIZE = 16;
+
+const int DIGEST_LENGTH = 32; // in hex digits
+
 QString cachePathFromPathAndKey(const QString& path, const QString& key) {
     return QFileInfo(QDir(path), key).absoluteFilePath();
 }
+
+int hexDigitValue(QChar c)
+{
+    if (c >= '0' && c <= '9') {
+        return c.unicode() - '0';
+    }
+    // only the lower case ones, or the name wouldn't be spelled the same again
+    if (c >= 'a' && c <= 'f') {
+        return c.unicode() - 'a' + 10;
+    }
+    return -1;
+}
+
+// a digest starting there, and not just the beginning of a longer hex string
+bool isDigestAt(const QString& name, int position)
+{
+    if (position + DIGEST_LENGTH > name.size()) {
+        return false;
+    }
+    for (int i = position; i < position + DIGEST_LENGTH; ++i) {
+        if (hexDigitValue(name[i]) < 0) {
+            return false;
+        }
+    }
+    return position + DIGEST_LENGTH == name.size() || hexDigitValue(name[position + DIGEST_LENGTH]) < 0;
+}
+
+// There are only a few prefixes and suffixes (one per generation and
+// format), so all the keys share the same few strings. Only used from the
+// thread of the cache.
+QString sharedPart(const QString& part)
+{
+    static QSet<QString> parts;
+    QSet<QString>::const_iterator it = parts.constFind(part);
+    if (it == parts.constEnd()) {
+        it = parts.insert(part);
+    }
+    return *it;
+}
 } // namespace {}
 
 //------------------------------------------------------------------------------
 
+FileCacheKey::FileCacheKey()
+    : m_hasDigest(false)
+{
+    m_digest[0] = m_digest[1] = 0;
+}
+
+FileCacheKey::FileCacheKey(const QString &name)
+    : m_hasDigest(false)
+{
+    m_digest[0] = m_digest[1] = 0;
+
+    int position = -1;
+    if (isDigestAt(name, 0)) {
+        position = 0;
+    } else {
+        const int separator = name.indexOf(GENERATION_SEPARATOR);
+        if (separator >= 0 && isDigestAt(name, separator + 1)) {
+            position = separator + 1;
+        }
+    }
+    if (position < 0) {
+        m_prefix = name;
+        return;
+    }
+
+    m_hasDigest = true;
+    for (int i = 0; i < DIGEST_LENGTH; ++i) {
+        quint64& word = m_digest[i * 2 / DIGEST_LENGTH];
+        word = (word << 4) | quint64(hexDigitValue(name[position + i]));
+    }
+    m_prefix = sharedPart(name.left(position));
+    m_suffix = sharedPart(name.mid(position + DIGEST_LENGTH));
+}
+
+QString FileCacheKey::toString() const
+{
+    if (!m_hasDigest) {
+        return m_prefix;
+    }
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    QString name;
+    name.reserve(m_prefix.size() + DIGEST_LENGTH + m_suffix.size());
+    name += m_prefix;
+    for (int i = 0; i < DIGEST_LENGTH; ++i) {
+        const quint64 word = m_digest[i * 2 / DIGEST_LENGTH];
+        const int shift = 4 * (DIGEST_LENGTH / 2 - 1 - i % (DIGEST_LENGTH / 2));
+        name += QChar(HEX_DIGITS[(word >> shift) & 0xf]);
+    }
+    name += m_suffix;
+    return name;
+}
+
+bool FileCacheKey::startsWith(const QString &prefix) const
+{
+    if (m_prefix.size() >= prefix.size()) {
+        return m_prefix.startsWith(prefix);
+    }
+    return m_hasDigest && toString().startsWith(prefix);
+}
+
+bool FileCacheKey::operator==(const FileCacheKey &other) const
+{
+    return m_hasDigest == other.m_hasDigest &&
+            m_digest[0] == other.m_digest[0] && m_digest[1] == other.m_digest[1] &&
+            m_prefix == other.m_prefix && m_suffix == other.m_suffix;
+}
+
+uint qHash(const FileCacheKey &key)
+{
+    if (!key.m_hasDigest) {
+        return qHash(key.m_prefix);
+    }
+    // the digest is spread well enough already
+    return uint(key.m_digest[1]) ^ uint(key.m_digest[1] >> 32) ^ qHash(key.m_suffix) ^ (qHash(key.m_prefix) << 1);
+}
+
+//------------------------------------------------------------------------------
+
 AbstractFileCacheItem::AbstractFileCacheItem(const QString& path, const QString &key, int cost, const QDateTime &date_time, QObject* parent)
     : QObject(parent)
-    , m_path(cachePathFromPathAndKey(path, key))
+    , m_dir(path)
     , m_key(key)
     , m_cost(cost)
     , m_dateTime(date_time)
+    , m_older(0)
+    , m_newer(0)
 {
-//    qDebug() << qPrintable(QString("new file cache item ->   key: %1   cost: %2   path: %3").arg(key, -10).arg(cost, -5).arg(m_path));
+//    qDebug() << qPrintable(QString("new file cache item ->   key: %1   cost: %2   path: %3").arg(key, -10).arg(cost, -5).arg(path()));
 }
 
 AbstractFileCacheItem::~AbstractFileCacheItem()
 {
 }
 
+QString AbstractFileCacheItem::path() const
+{
+    return cachePathFromPathAndKey(m_dir, key());
+}
+
 //------------------------------------------------------------------------------
 
 FileCacheItem::FileCacheItem(const QString& path, const QString &key, int cost, const QDateTime &date_time, QObject *parent)
@@ -45,18 +179,189 @@ void FileCacheItem::removeFileFromDisk(const QString& some_path) const
             )
         throw FileCacheError();
 
-    QDir().remove(path());
+    // in the background, after its own write if that's still queued
+    FileCache* cache = qobject_cast<FileCache*>(parent());
+    if (cache) {
+        cache->removeFile(path());
+    } else {
+        QDir().remove(path());
+    }
 //    qDebug() << qPrintable(QString("removed cached file ->   key: %1   cost: %2   path: %3").arg(key(), -10).arg(cost(), -5).arg(path()));
     m_removed = true;
 }
 
 //------------------------------------------------------------------------------
 
+FileCacheWriter::FileCacheWriter(QObject *parent)
+    : QThread(parent)
+    , m_lastSerial(0)
+    , m_doneSerial(0)
+    , m_stopping(false)
+{
+}
+
+FileCacheWriter::~FileCacheWriter()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_queued.wakeAll();
+    }
+    wait(); // the queue is emptied first
+}
+
+qint64 FileCacheWriter::write(const QString &path, const QByteArray &data)
+{
+    Operation operation;
+    operation.type = Operation::Write;
+    operation.path = path;
+    operation.data = data;
+    return enqueue(operation);
+}
+
+qint64 FileCacheWriter::append(const QString &path, const QByteArray &data)
+{
+    Operation operation;
+    operation.type = Operation::Append;
+    operation.path = path;
+    operation.data = data;
+    return enqueue(operation);
+}
+
+qint64 FileCacheWriter::rename(const QString &from_path, const QString &to_path)
+{
+    Operation operation;
+    operation.type = Operation::Rename;
+    operation.path = from_path;
+    operation.toPath = to_path;
+    return enqueue(operation);
+}
+
+qint64 FileCacheWriter::remove(const QString &path)
+{
+    Operation operation;
+    operation.type = Operation::Remove;
+    operation.path = path;
+    return enqueue(operation);
+}
+
+void FileCacheWriter::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_doneSerial < m_lastSerial) {
+        m_done.wait(&m_mutex);
+    }
+}
+
+QList<qint64> FileCacheWriter::takeProgress(qint64 *done_serial)
+{
+    QMutexLocker locker(&m_mutex);
+    *done_serial = m_doneSerial;
+    QList<qint64> failures = m_failures;
+    m_failures.clear();
+    return failures;
+}
+
+void FileCacheWriter::run()
+{
+    QMutexLocker locker(&m_mutex);
+    forever {
+        while (m_queue.isEmpty() && !m_stopping) {
+            m_queued.wait(&m_mutex);
+        }
+        if (m_queue.isEmpty()) {
+            return; // stopping, and nothing left
+        }
+
+        const Operation operation = m_queue.dequeue();
+        locker.unlock();
+        const bool success = perform(operation);
+        locker.relock();
+
+        m_doneSerial = operation.serial;
+        if (!success) {
+            m_failures << operation.serial;
+        }
+        m_done.wakeAll();
+        if (m_queue.isEmpty() || !success) {
+            emit progressed();
+        }
+    }
+}
+
+qint64 FileCacheWriter::enqueue(FileCacheWriter::Operation operation)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        operation.serial = ++m_lastSerial;
+        m_queue.enqueue(operation);
+        m_queued.wakeOne();
+    }
+    if (!isRunning()) {
+        start(QThread::LowPriority);
+    }
+    return operation.serial;
+}
+
+bool FileCacheWriter::perform(const FileCacheWriter::Operation &operation)
+{
+    switch (operation.type) {
+    case Operation::Write: {
+        QFile file(operation.path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        if (file.write(operation.data) != operation.data.size()) {
+            file.close();
+            file.remove(); // the disk is full, most likely
+            return false;
+        }
+        return true;
+    }
+    case Operation::Append: {
+        // or a write that failed would be followed by a file missing its
+        // beginning
+        QFile file(operation.path);
+        if (!file.exists() || !file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            return false;
+        }
+        if (file.write(operation.data) != operation.data.size()) {
+            file.close();
+            file.remove();
+            return false;
+        }
+        return true;
+    }
+    case Operation::Rename:
+        QFile::remove(operation.toPath);
+        if (!QFile::rename(operation.path, operation.toPath)) {
+            QFile::remove(operation.path);
+            return false;
+        }
+        return true;
+    case Operation::Remove:
+        QDir().remove(operation.path);
+        return true;
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
 FileCache::FileCache(int size, QObject *parent)
     : QObject(parent)
     , m_maxCost(size)
     , m_totalCost(0)
+    , m_partialItemCount(0)
+    , m_oldest(0)
+    , m_newest(0)
 {
+    m_collectTimer = new QTimer(this);
+    m_collectTimer->setInterval(COLLECT_INTERVAL);
+    connect(m_collectTimer, SIGNAL(timeout()), this, SLOT(onCollectTimeout()));
+
+    m_writer = new FileCacheWriter(this);
+    connect(m_writer, SIGNAL(progressed()), this, SLOT(onWritesProgressed()));
 }
 
 FileCache::~FileCache()
@@ -64,6 +369,7 @@ FileCache::~FileCache()
     foreach (AbstractFileCacheItem* item, m_items) {
         delete item;
     }
+    m_writer->flush();
 }
 
 void FileCache::setMaxCost(int max_cost)
@@ -71,14 +377,14 @@ void FileCache::setMaxCost(int max_cost)
     m_maxCost = max_cost;
 }
 
-bool FileCache::hasItem(const QString &key) const
+bool FileCache::hasItem(const FileCacheKey &key) const
 {
     return m_items.contains(key);
 }
 
 void FileCache::addItem(AbstractFileCacheItem *item)
 {
-    AbstractFileCacheItem* old_item = m_items.value(item->key());
+    AbstractFileCacheItem* old_item = m_items.value(item->cacheKey());
     if (old_item) {
         if (old_item == item || // adding the same item twice is an error
                 old_item->path() != item->path() // adding with same key but different path is not supported
@@ -86,54 +392,121 @@ void FileCache::addItem(AbstractFileCacheItem *item)
             throw FileCacheError();
         }
         m_totalCost += item->cost() - old_item->cost();
-        m_indexByDate.removeOne(item->key());
-        m_items.remove(item->key());
+        unlink(old_item);
         delete old_item;
     } else {
         m_totalCost += item->cost();
     }
 
-    m_items[item->key()] = item;
+    m_items[item->cacheKey()] = item;
+    link(item);
+    item->setParent(this);
 
-    bool index_by_date_updated = false;
-    for(int index = 0; index < m_indexByDate.size(); index++) {
-        if (m_items[m_indexByDate[index]]->dateTime() > item->dateTime()) {
-            m_indexByDate.insert(index, item->key());
-            index_by_date_updated = true;
-            break;
-        }
-    }
-    if (!index_by_date_updated) {
-        m_indexByDate.append(item->key());
+    while (m_totalCost > m_maxCost && m_items.size() > 1) {
+        removeItem(m_oldest);
     }
+}
 
-    item->setParent(this);
+void FileCache::addItem(const QByteArray &data, const QString &key, FileCache::ItemGenerator item_generator)
+{
+    collectWrites();
+
+    const FileCacheKey cache_key(key);
+    const QString path = cachePathFromPathAndKey(m_path, key);
 
-    while (m_totalCost > m_maxCost && m_indexByDate.size() > 1) {
-        QString tmp_key = m_indexByDate.value(0);
-        const AbstractFileCacheItem* tmp_item = m_items.value(tmp_key);
-        Q_ASSERT(tmp_item);
-        m_totalCost -= tmp_item->cost();
-        tmp_item->removeFileFromDisk();
-        m_items.remove(tmp_key);
-        m_indexByDate.removeAt(0);
-        delete tmp_item;
+    // the eviction it causes is queued first, the files removed may make
+    // room for this one
+    AbstractFileCacheItem* item = item_generator(m_path, key, data.size(), QDateTime::currentDateTime(), this);
+    addItem(item);
+    if (m_items.value(cache_key) != item) {
+        return; // evicted right away, older than the ones filling the cache
     }
+
+    PendingWrite pending;
+    pending.data = data;
+    pending.serial = m_writer->write(path, data);
+    m_pendingWrites[cache_key] = pending;
 }
 
-void FileCache::addItem(const QByteArray &data, const QString &key, FileCache::ItemGenerator item_generator)
+QString FileCache::partialItemPath(const QString &key)
+{
+    // unique, the same key may be written by several renders at once
+    return cachePathFromPathAndKey(m_path, QString("%1.%2%3")
+                                   .arg(key)
+                                   .arg(++m_partialItemCount)
+                                   .arg(PARTIAL_ITEM_SUFFIX));
+}
+
+void FileCache::addPartialItem(const QString &partial_path, const QString &key, const QByteArray &data, FileCache::ItemGenerator item_generator)
 {
-    QFile file(cachePathFromPathAndKey(m_path, key));
-    if (!file.open(QIODevice::WriteOnly)) {
+    collectWrites();
+
+    const FileCacheKey cache_key(key);
+    const QString path = cachePathFromPathAndKey(m_path, key);
+
+    // the partial file may still be queued for writing, after which it's
+    // renamed: it's never looked at from here
+    AbstractFileCacheItem* item = item_generator(m_path, key, data.size(), QDateTime::currentDateTime(), this);
+    addItem(item);
+    if (m_items.value(cache_key) != item) {
+        m_writer->remove(partial_path); // evicted right away
         return;
     }
-    file.write(data);
-    file.close();
 
-    QFileInfo info(QDir(m_path), key);
-    int cost = info.size();
-    QDateTime date_time = info.lastModified();
-    addItem(item_generator(m_path, key, cost, date_time, this));
+    PendingWrite pending;
+    pending.data = data;
+    pending.serial = m_writer->rename(partial_path, path);
+    m_pendingWrites[cache_key] = pending;
+}
+
+QByteArray FileCache::itemData(const QString &key) const
+{
+    const FileCacheKey cache_key(key);
+    const AbstractFileCacheItem* item = m_items.value(cache_key);
+    if (!item) {
+        return QByteArray();
+    }
+    QHash<FileCacheKey, PendingWrite>::const_iterator pending = m_pendingWrites.constFind(cache_key);
+    if (pending != m_pendingWrites.constEnd()) {
+        return pending->data;
+    }
+
+    QFile file(item->path());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+void FileCache::removeFile(const QString &path)
+{
+    m_writer->remove(path);
+}
+
+void FileCache::flush()
+{
+    m_writer->flush();
+    collectWrites();
+}
+
+void FileCache::touch(const QString &key)
+{
+    AbstractFileCacheItem* item = m_items.value(FileCacheKey(key));
+    if (item) {
+        unlink(item);
+        item->m_dateTime = QDateTime::currentDateTime();
+        link(item);
+    }
+}
+
+QList<QString> FileCache::keys() const
+{
+    QList<QString> keys;
+    keys.reserve(m_items.size());
+    for (const AbstractFileCacheItem* item = m_oldest; item; item = item->m_newer) {
+        keys << item->key();
+    }
+    return keys;
 }
 
 void FileCache::clear()
@@ -142,8 +515,11 @@ void FileCache::clear()
         delete item;
     }
     m_items.clear();
-    m_indexByDate.clear();
+    m_pendingWrites.clear();
+    m_oldest = 0;
+    m_newest = 0;
     m_totalCost = 0;
+    m_collectTimer->stop();
 }
 
 void FileCache::clearFromDisk()
@@ -155,17 +531,21 @@ void FileCache::clearFromDisk()
         delete item;
     }
     m_items.clear();
-    m_indexByDate.clear();
+    m_pendingWrites.clear();
+    m_oldest = 0;
+    m_newest = 0;
     m_totalCost = 0;
 }
 
 bool FileCache::setPath(const QString &path, ItemGenerator item_generator)
 {
     if (m_path != path) {
+        flush(); // or the partial files being renamed would look left behind
         clear();
         bool success = updateFromDisk(path, item_generator);
         if (success) {
             m_path = path;
+            scheduleCollection();
         }
         return success;
     }
@@ -179,7 +559,16 @@ bool FileCache::updateFromDisk(const QString &path, ItemGenerator item_generator
         return false;
     }
 
-    foreach (QFileInfo info, dir.entryInfoList(QDir::Files)) {
+    // oldest first, each one is then added at the newest end of the list
+    QList<QFileInfo> infos = dir.entryInfoList(QDir::Files);
+    std::stable_sort(infos.begin(), infos.end(), [](const QFileInfo& a, const QFileInfo& b) {
+        return a.lastRead() < b.lastRead();
+    });
+    foreach (QFileInfo info, infos) {
+        if (info.fileName().endsWith(PARTIAL_ITEM_SUFFIX)) {
+            dir.remove(info.fileName()); // an interrupted write
+            continue;
+        }
         QString key = info.fileName();
         int cost = info.size();
         QDateTime date_time = info.lastRead();
@@ -188,4 +577,142 @@ bool FileCache::updateFromDisk(const QString &path, ItemGenerator item_generator
     return true;
 }
 
+void FileCache::setGeneration(const QString &generation)
+{
+    if (m_generation != generation) {
+        m_generation = generation;
+        scheduleCollection();
+    }
+}
+
+QString FileCache::keyInGeneration(const QString &name) const
+{
+    return m_generation.isEmpty() ? name : m_generation + GENERATION_SEPARATOR + name;
+}
+
+bool FileCache::isStale(const FileCacheKey &key) const
+{
+    return !m_generation.isEmpty() && !key.startsWith(m_generation + GENERATION_SEPARATOR);
+}
+
+int FileCache::staleItemCount() const
+{
+    int count = 0;
+    for (const AbstractFileCacheItem* item = m_oldest; item; item = item->m_newer) {
+        if (isStale(item->cacheKey())) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+bool FileCache::collectStaleItems(int max_count)
+{
+    AbstractFileCacheItem* item = m_oldest;
+    while (item) {
+        AbstractFileCacheItem* newer = item->m_newer;
+        if (isStale(item->cacheKey())) {
+            if (max_count-- <= 0) {
+                return true;
+            }
+            removeItem(item);
+        }
+        item = newer;
+    }
+    return false;
+}
+
+void FileCache::onWritesProgressed()
+{
+    collectWrites();
+}
+
+void FileCache::onCollectTimeout()
+{
+    if (!collectStaleItems(COLLECT_BATCH_SIZE)) {
+        m_collectTimer->stop();
+        emit staleItemsCollected();
+    }
+}
+
+void FileCache::link(AbstractFileCacheItem *item)
+{
+    // usually the newest one, found right away
+    AbstractFileCacheItem* older = m_newest;
+    while (older && older->dateTime() > item->dateTime()) {
+        older = older->m_older;
+    }
+
+    AbstractFileCacheItem* newer = older ? older->m_newer : m_oldest;
+    item->m_older = older;
+    item->m_newer = newer;
+    if (older) {
+        older->m_newer = item;
+    } else {
+        m_oldest = item;
+    }
+    if (newer) {
+        newer->m_older = item;
+    } else {
+        m_newest = item;
+    }
+}
+
+void FileCache::unlink(AbstractFileCacheItem *item)
+{
+    if (item->m_older) {
+        item->m_older->m_newer = item->m_newer;
+    } else {
+        m_oldest = item->m_newer;
+    }
+    if (item->m_newer) {
+        item->m_newer->m_older = item->m_older;
+    } else {
+        m_newest = item->m_older;
+    }
+    item->m_older = 0;
+    item->m_newer = 0;
+}
+
+void FileCache::removeItem(AbstractFileCacheItem *item)
+{
+    unlink(item);
+    m_items.remove(item->cacheKey());
+    m_pendingWrites.remove(item->cacheKey());
+    m_totalCost -= item->cost();
+    item->removeFileFromDisk();
+    delete item;
+}
+
+void FileCache::collectWrites()
+{
+    qint64 done_serial = 0;
+    const QList<qint64> failures = m_writer->takeProgress(&done_serial);
+    QList<AbstractFileCacheItem*> failed_items;
+    QHash<FileCacheKey, PendingWrite>::iterator it = m_pendingWrites.begin();
+    while (it != m_pendingWrites.end()) {
+        if (it->serial > done_serial) {
+            ++it;
+            continue;
+        }
+        if (failures.contains(it->serial)) {
+            failed_items << m_items.value(it.key());
+        }
+        it = m_pendingWrites.erase(it);
+    }
+    // not on disk, they can't be read once their data is forgotten
+    foreach (AbstractFileCacheItem* item, failed_items) {
+        if (item) {
+            removeItem(item);
+        }
+    }
+}
+
+void FileCache::scheduleCollection()
+{
+    if (staleItemCount() > 0) {
+        m_collectTimer->start();
+    }
+}
+
 //------------------------------------------------------------------------------
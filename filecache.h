@@ -5,8 +5,14 @@
 #include <QObject>
 #include <QString>
 #include <QDateTime>
-#include <QMap>
+#include <QHash>
 #include <QSet>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+
+class QTimer;
 
 //------------------------------------------------------------------------------
 
@@ -14,6 +20,36 @@ struct FileCacheError {};
 
 //------------------------------------------------------------------------------
 
+// The key of an item, as kept in memory. The keys made by the editor look
+// like "<generation>-<32 hex digits>.<format>": the digits are kept as a 16
+// byte digest, and the text around them is shared by all the keys with the
+// same generation and format. Other keys are kept as they are. The name of
+// the file is only spelled out again when it's needed.
+class FileCacheKey
+{
+public:
+    FileCacheKey();
+    explicit FileCacheKey(const QString& name);
+
+    QString toString() const;
+    bool startsWith(const QString& prefix) const;
+
+    bool operator==(const FileCacheKey& other) const;
+    bool operator!=(const FileCacheKey& other) const { return !(*this == other); }
+
+private:
+    friend uint qHash(const FileCacheKey& key);
+
+    bool m_hasDigest;
+    quint64 m_digest[2];
+    QString m_prefix; //< the whole name without a digest
+    QString m_suffix;
+};
+
+uint qHash(const FileCacheKey& key);
+
+//------------------------------------------------------------------------------
+
 class AbstractFileCacheItem : public QObject
 {
     Q_OBJECT
@@ -21,21 +57,27 @@ public:
     explicit AbstractFileCacheItem(const QString& path, const QString& key, int cost, const QDateTime& date_time, QObject* parent = 0);
     virtual ~AbstractFileCacheItem();
 
-    const QString& path() const { return m_path; }
-    const QString& key() const { return m_key; }
+    QString path() const;
+    QString key() const { return m_key.toString(); }
+    const FileCacheKey& cacheKey() const { return m_key; }
     int cost() const { return m_cost; }
     const QDateTime& dateTime() const { return m_dateTime; }
 
-    void removeFileFromDisk() const { removeFileFromDisk(m_path); }
+    void removeFileFromDisk() const { removeFileFromDisk(path()); }
 
 protected:
     virtual void removeFileFromDisk(const QString& path) const = 0;
 
 private:
-    QString m_path;
-    QString m_key;
+    friend class FileCache;
+
+    QString m_dir; //< the path of the cache, shared by its items
+    FileCacheKey m_key;
     int m_cost;
     QDateTime m_dateTime;
+    // the neighbours in the recency list of the cache
+    AbstractFileCacheItem* m_older;
+    AbstractFileCacheItem* m_newer;
 };
 
 //------------------------------------------------------------------------------
@@ -55,6 +97,67 @@ private:
 
 //------------------------------------------------------------------------------
 
+// Writes, renames and removes the files of a FileCache in a thread of its
+// own, in the order they were asked for, so the editor never waits for the
+// disk. The render workers stream their partial files through it too. The
+// thread runs its own queue rather than an event loop, and is only started
+// with the first operation. Whatever is still queued is done before the
+// writer is destroyed.
+class FileCacheWriter : public QThread
+{
+    Q_OBJECT
+public:
+    explicit FileCacheWriter(QObject* parent = 0);
+    virtual ~FileCacheWriter();
+
+    // each returns the serial number of its operation, counting from 1
+    qint64 write(const QString& path, const QByteArray& data);
+    // to a file already written, it fails if the file isn't there anymore
+    qint64 append(const QString& path, const QByteArray& data);
+    qint64 rename(const QString& from_path, const QString& to_path);
+    qint64 remove(const QString& path);
+
+    // waits until all the operations asked for so far are done
+    void flush();
+    // The writes, appends and renames which failed since the last call, and
+    // the serial the operations are done up to (they're done in order), read
+    // together: a failure is never reported before its operation is done.
+    QList<qint64> takeProgress(qint64* done_serial);
+
+signals:
+    // emitted from the thread of the writer, once it has nothing left to do
+    // or something failed
+    void progressed();
+
+protected:
+    virtual void run();
+
+private:
+    struct Operation
+    {
+        enum Type { Write, Append, Rename, Remove };
+        Type type;
+        QString path;
+        QString toPath; //< of a rename
+        QByteArray data; //< of a write or an append
+        qint64 serial;
+    };
+
+    qint64 enqueue(Operation operation);
+    static bool perform(const Operation& operation);
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_queued;
+    QWaitCondition m_done;
+    QQueue<Operation> m_queue;
+    qint64 m_lastSerial;
+    qint64 m_doneSerial;
+    QList<qint64> m_failures;
+    bool m_stopping;
+};
+
+//------------------------------------------------------------------------------
+
 class FileCache : public QObject
 {
     Q_OBJECT
@@ -72,15 +175,41 @@ public:
     int maxCost() const { return m_maxCost; }
     void setMaxCost(int max_cost);
 
-    bool hasItem(const QString& key) const;
+    bool hasItem(const QString& key) const { return hasItem(FileCacheKey(key)); }
+    bool hasItem(const FileCacheKey& key) const;
     void addItem(AbstractFileCacheItem* item);
+    // The item is added right away, its file is written in the background
+    // (write-behind): itemData() has its data meanwhile. It's dropped again
+    // if the file can't be written.
     void addItem(const QByteArray& data, const QString& key, ItemGenerator item_generator);
 
+    // An item can also be written to disk progressively: the data goes to a
+    // partial file first (through writer()), which becomes the item once it's
+    // complete (it's renamed in the background too). The data given is what
+    // was written, itemData() has it until the file is renamed. Partial files
+    // left behind are removed the next time the cache is loaded.
+    QString partialItemPath(const QString& key);
+    void addPartialItem(const QString& partial_path, const QString& key, const QByteArray& data, ItemGenerator item_generator);
+    FileCacheWriter* writer() const { return m_writer; }
+
+    // from memory while it isn't written yet, empty if it can't be read
+    QByteArray itemData(const QString& key) const;
+    // removes a file of the cache in the background
+    void removeFile(const QString& path);
+    // waits for the files still being written or removed, done on destruction
+    void flush();
+
     int totalCost() const { return m_totalCost; }
 
+    // makes an item the most recently used one, the last to be removed
+    void touch(const QString& key);
+    // the least recently used item, the first to be removed, 0 if empty
+    const AbstractFileCacheItem* oldestItem() const { return m_oldest; }
+
     int size() const { return m_items.size(); }
-    QList<QString> keys() const { return m_items.keys(); }
-    const AbstractFileCacheItem* item(const QString& key) const { return m_items.value(key); }
+    QList<QString> keys() const;
+    const AbstractFileCacheItem* item(const QString& key) const { return item(FileCacheKey(key)); }
+    const AbstractFileCacheItem* item(const FileCacheKey& key) const { return m_items.value(key); }
 
     void clear();
     void clearFromDisk();
@@ -88,14 +217,58 @@ public:
     bool setPath(const QString& path, ItemGenerator item_generator);
     const QString& path() const { return m_path; }
 
+    // The items are namespaced by generation, with keys like
+    // "<generation>-<name>". Once the generation changes, the items of the
+    // other ones (and those of none) are stale: they are removed a few at a
+    // time in the background, oldest first, while the new generation fills
+    // up. Empty for no generations at all.
+    const QString& generation() const { return m_generation; }
+    void setGeneration(const QString& generation);
+    QString keyInGeneration(const QString& name) const;
+    bool isStale(const QString& key) const { return isStale(FileCacheKey(key)); }
+    bool isStale(const FileCacheKey& key) const;
+    int staleItemCount() const;
+    // removes up to this many stale items, false once there are none left
+    bool collectStaleItems(int max_count);
+
+signals:
+    void staleItemsCollected(); //< the last of them
+
+private slots:
+    void onCollectTimeout();
+    void onWritesProgressed();
+
 private:
+    // an item whose file isn't on disk yet
+    struct PendingWrite
+    {
+        PendingWrite() : serial(0) {}
+
+        QByteArray data; //< written, or in the partial file being renamed
+        qint64 serial; //< of the operation of the writer
+    };
+
+    // forgets the writes done, and the items which couldn't be written
+    void collectWrites();
     bool updateFromDisk(const QString &path, ItemGenerator item_generator);
+    // the items are kept in a list by date, oldest first: adding the newest
+    // one, touching one or removing one takes a constant time
+    void link(AbstractFileCacheItem* item);
+    void unlink(AbstractFileCacheItem* item);
+    void removeItem(AbstractFileCacheItem* item); //< from the disk too
+    void scheduleCollection();
 
     QString m_path;
     int m_maxCost;
     int m_totalCost;
-    QMap<QString, AbstractFileCacheItem*> m_items;
-    QList<QString> m_indexByDate;
+    int m_partialItemCount;
+    QHash<FileCacheKey, AbstractFileCacheItem*> m_items;
+    AbstractFileCacheItem* m_oldest;
+    AbstractFileCacheItem* m_newest;
+    QString m_generation;
+    QTimer* m_collectTimer;
+    FileCacheWriter* m_writer;
+    QHash<FileCacheKey, PendingWrite> m_pendingWrites;
 };
 
 //------------------------------------------------------------------------------
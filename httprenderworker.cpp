@@ -0,0 +1,281 @@
+#include "httprenderworker.h"
+#include "picowebserver.h"
+#include "filecache.h"
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <QTimer>
+#include <QDebug>
+
+//------------------------------------------------------------------------------
+
+namespace {
+const QString RENDER_PATH = "/render";
+// set by the server when the diagram has a syntax error, the body is then an
+// image of the error
+const QByteArray DIAGRAM_ERROR_HEADER = "X-PlantUML-Diagram-Error";
+const QByteArray DIAGRAM_ERROR_LINE_HEADER = "X-PlantUML-Diagram-Error-Line";
+// like a crash of the -pipe process, losing the connection is forgiven once
+const int MAX_JOB_ATTEMPTS = 2;
+// requests in flight per worker, the others stay queued so they can still be
+// cancelled or stolen by another worker
+const int MAX_PENDING_REQUESTS = 4;
+// background jobs leave the other connections to the more urgent ones
+const int MAX_PENDING_BACKGROUND_REQUESTS = 1;
+// how often the requests in flight are checked against the timeout
+const int WATCHDOG_INTERVAL = 500; // in miliseconds
+
+QByteArray jsonString(const QByteArray& data)
+{
+    QByteArray result;
+    result.reserve(data.size() + 16);
+    result += '"';
+    foreach (char c, data) {
+        switch (c) {
+        case '"': result += "\\\""; break;
+        case '\\': result += "\\\\"; break;
+        case '\n': result += "\\n"; break;
+        case '\r': result += "\\r"; break;
+        case '\t': result += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                result += "\\u00" + QByteArray::number(int(static_cast<unsigned char>(c)), 16).rightJustified(2, '0');
+            } else {
+                result += c; // UTF-8 goes through as is
+            }
+        }
+    }
+    result += '"';
+    return result;
+}
+
+// the body expected by the server's /render: {"source": ..., "options": [...]}
+QByteArray renderRequestBody(const RenderJob* job)
+{
+    return "{\"source\":" + jsonString(job->document()) +
+            ",\"options\":[" + jsonString("-t" + job->format().toLatin1()) + "]}";
+}
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+HttpRenderWorker::HttpRenderWorker(PicowebServer *server, QObject *parent)
+    : AbstractRenderWorker(parent)
+    , m_server(server)
+{
+    connect(m_server, SIGNAL(listening()), this, SLOT(onServerListening()));
+    connect(m_server, SIGNAL(failed(QString)), this, SLOT(onServerFailed(QString)));
+
+    m_watchdog = new QTimer(this);
+    m_watchdog->setInterval(WATCHDOG_INTERVAL);
+    connect(m_watchdog, SIGNAL(timeout()), this, SLOT(onWatchdogTimeout()));
+    m_clock.start();
+}
+
+HttpRenderWorker::~HttpRenderWorker()
+{
+    stop();
+}
+
+bool HttpRenderWorker::isWarmFor(const QString &format) const
+{
+    Q_UNUSED(format);
+    return m_server->isListening();
+}
+
+void HttpRenderWorker::stop()
+{
+    // put the jobs back in the order they were posted
+    while (!m_replies.isEmpty()) {
+        QNetworkReply* reply = m_replies.takeLast();
+        RenderJob* job = m_jobs.take(reply);
+        m_postTimes.remove(reply);
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+
+        --job->m_attempts; // not its fault
+        job->m_state = RenderJob::Queued;
+        job->m_output.clear();
+        job->m_errorString.clear();
+        requeue(job);
+    }
+    if (!m_queue.isEmpty()) {
+        m_queue.head()->m_state = RenderJob::Queued; // it may have been Starting
+    }
+    m_watchdog->stop();
+}
+
+void HttpRenderWorker::onServerListening()
+{
+    processNext();
+}
+
+void HttpRenderWorker::onServerFailed(const QString &reason)
+{
+    // the server can't be started with these settings, don't try it again
+    // for every queued job
+    QList<RenderJob*> jobs = takeQueuedJobs();
+    foreach (RenderJob* job, jobs) {
+        finishJob(job, reason);
+    }
+}
+
+void HttpRenderWorker::onReplyDownloadProgress(qint64 received, qint64 total)
+{
+    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
+    RenderJob* job = m_jobs.value(reply);
+    if (!job || m_maxOutputSize <= 0) {
+        return;
+    }
+
+    if (received > m_maxOutputSize || total > m_maxOutputSize) {
+        job->m_errorString = tr("The image is larger than the limit of %1 bytes").arg(m_maxOutputSize);
+        reply->abort(); // finishes the reply
+    }
+}
+
+void HttpRenderWorker::onReplyFinished()
+{
+    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
+    if (!reply || !m_jobs.contains(reply)) {
+        return;
+    }
+    RenderJob* job = m_jobs.take(reply);
+    m_replies.removeOne(reply);
+    m_postTimes.remove(reply);
+    reply->deleteLater();
+    if (m_replies.isEmpty()) {
+        m_watchdog->stop();
+    }
+
+    const bool answered = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).isValid();
+    if (job->hasError()) {
+        // aborted because it's too large, or too slow
+        finishJob(job, job->errorString());
+    } else if (reply->error() == QNetworkReply::NoError) {
+        if (reply->hasRawHeader(DIAGRAM_ERROR_HEADER)) {
+            // the same layout as the error frames of the -pipe mode
+            finishJob(job, QString("ERROR\n%1\n%2")
+                      .arg(QString::fromUtf8(reply->rawHeader(DIAGRAM_ERROR_LINE_HEADER)))
+                      .arg(QString::fromUtf8(reply->rawHeader(DIAGRAM_ERROR_HEADER))));
+        } else {
+            job->m_output = reply->readAll();
+            writeOutputFile(job);
+            finishJob(job, QString());
+        }
+    } else if (answered) {
+        // the server refused the request itself
+        QString error_string = QString::fromUtf8(reply->readAll()).trimmed();
+        finishJob(job, error_string.isEmpty() ? reply->errorString() : error_string);
+    } else if (job->attempts() < MAX_JOB_ATTEMPTS) {
+        qDebug() << "render request failed, trying again:" << reply->errorString();
+        job->m_state = RenderJob::Queued;
+        requeue(job);
+        m_server->connectionLost();
+    } else {
+        finishJob(job, reply->errorString());
+    }
+
+    processNext();
+}
+
+void HttpRenderWorker::onWatchdogTimeout()
+{
+    if (m_timeout <= 0) {
+        m_watchdog->stop();
+        return;
+    }
+
+    // replies finish (and leave m_replies) while they are aborted
+    const QList<QNetworkReply*> replies = m_replies;
+    foreach (QNetworkReply* reply, replies) {
+        RenderJob* job = m_jobs.value(reply);
+        const qint64 elapsed = m_clock.elapsed() - m_postTimes.value(reply);
+        if (!job || job->hasError() || elapsed < m_timeout) {
+            continue;
+        }
+
+        qDebug() << "render request timed out after" << elapsed << "ms:" << job->key();
+        job->m_timedOut = true;
+        job->m_errorString = tr("Rendering timed out after %1 seconds").arg(elapsed / 1000.0, 0, 'f', 1);
+        reply->abort(); // finishes the reply
+    }
+}
+
+void HttpRenderWorker::processNext()
+{
+    if (m_queue.isEmpty()) {
+        return;
+    }
+
+    if (!m_server->isListening()) {
+        m_queue.head()->m_state = RenderJob::Starting;
+        m_server->start(); // onServerListening() comes back here
+        return;
+    }
+
+    int background_count = 0;
+    foreach (RenderJob* job, m_jobs) {
+        if (job->priority() == RenderJob::BackgroundPriority) {
+            ++background_count;
+        }
+    }
+    while (!m_queue.isEmpty() && m_replies.size() < MAX_PENDING_REQUESTS) {
+        if (m_queue.head()->priority() == RenderJob::BackgroundPriority) {
+            if (background_count >= MAX_PENDING_BACKGROUND_REQUESTS) {
+                break;
+            }
+            ++background_count;
+        }
+        post(m_queue.dequeue());
+    }
+}
+
+void HttpRenderWorker::post(RenderJob *job)
+{
+    ++job->m_attempts;
+    job->m_state = RenderJob::Running;
+    job->m_output.clear();
+    job->m_errorString.clear();
+
+    QNetworkRequest request(m_server->url(RENDER_PATH));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+    request.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, true);
+
+    QNetworkReply* reply = m_server->networkAccessManager()->post(request, renderRequestBody(job));
+    connect(reply, SIGNAL(downloadProgress(qint64,qint64)), this, SLOT(onReplyDownloadProgress(qint64,qint64)));
+    connect(reply, SIGNAL(finished()), this, SLOT(onReplyFinished()));
+    m_replies << reply;
+    m_jobs.insert(reply, job);
+    m_postTimes.insert(reply, m_clock.elapsed());
+    if (m_timeout > 0 && !m_watchdog->isActive()) {
+        m_watchdog->start();
+    }
+}
+
+void HttpRenderWorker::finishJob(RenderJob *job, const QString &error_string)
+{
+    job->m_errorString = error_string;
+    if (job->hasError()) {
+        job->m_state = RenderJob::Failed;
+        job->m_output.clear();
+    } else {
+        job->m_state = RenderJob::Done;
+    }
+
+    emit jobFinished(job);
+    job->deleteLater();
+}
+
+void HttpRenderWorker::writeOutputFile(RenderJob *job)
+{
+    if (job->outputPath().isEmpty()) {
+        return;
+    }
+
+    // the whole image at once, in the background
+    outputWriter()->write(job->outputPath(), job->m_output);
+}
+
+//------------------------------------------------------------------------------
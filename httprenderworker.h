@@ -0,0 +1,62 @@
+#ifndef HTTPRENDERWORKER_H
+#define HTTPRENDERWORKER_H
+
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <QElapsedTimer>
+#include "renderworker.h"
+
+class QNetworkReply;
+class QTimer;
+class PicowebServer;
+
+//------------------------------------------------------------------------------
+
+// Renders the queued jobs by posting them to a PlantUML HTTP server. Requests
+// go through the server's QNetworkAccessManager, which keeps its connections
+// alive between refreshes, and a few of them are kept in flight (pipelined
+// when the server allows it). Replies may arrive in any order. A request that
+// can't reach the server is tried again once, after the server is started
+// again if it went away. A request still unanswered after timeout() is
+// abandoned: the server is shared by all the jobs, so it isn't killed.
+class HttpRenderWorker : public AbstractRenderWorker
+{
+    Q_OBJECT
+public:
+    explicit HttpRenderWorker(PicowebServer* server, QObject* parent = 0);
+    virtual ~HttpRenderWorker();
+
+    virtual bool isBusy() const { return !m_replies.isEmpty() || !m_queue.isEmpty(); }
+    // the server renders any format
+    virtual bool isWarmFor(const QString& format) const;
+
+    virtual void stop();
+
+private slots:
+    void onServerListening();
+    void onServerFailed(const QString& reason);
+    void onReplyDownloadProgress(qint64 received, qint64 total);
+    void onReplyFinished();
+    void onWatchdogTimeout();
+
+private:
+    virtual void processNext();
+    void post(RenderJob* job);
+    void finishJob(RenderJob* job, const QString& error_string);
+    void writeOutputFile(RenderJob* job);
+
+    PicowebServer* m_server;
+    // in the order they were posted
+    QList<QNetworkReply*> m_replies;
+    QHash<QNetworkReply*, RenderJob*> m_jobs;
+
+    QTimer* m_watchdog;
+    QElapsedTimer m_clock;
+    // when each reply was posted, on m_clock
+    QHash<QNetworkReply*, qint64> m_postTimes;
+};
+
+//------------------------------------------------------------------------------
+
+#endif // HTTPRENDERWORKER_H
@@ -0,0 +1,145 @@
+#include "includeresolver.h"
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+
+//------------------------------------------------------------------------------
+
+namespace {
+const char* INCLUDE_PREFIX = "!include";
+// !includeurl and !includedef don't name local files
+const char* const INCLUDE_DIRECTIVES[] = { "!include", "!include_many", "!include_once", "!includesub", 0 };
+// a file changed this soon after it was read may have changed again within
+// the resolution of its modification time
+const int MODIFICATION_TIME_SLACK = 2; // in seconds
+
+bool isIncludeDirective(const QByteArray& word)
+{
+    for (const char* const* directive = INCLUDE_DIRECTIVES; *directive; ++directive) {
+        if (word == *directive) {
+            return true;
+        }
+    }
+    return false;
+}
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+IncludeResolver::IncludeResolver()
+{
+}
+
+QStringList IncludeResolver::dependencies(const QByteArray &diagram, const QString &base_dir)
+{
+    QStringList dependencies;
+    QList<QByteArray> hashes;
+    addDependencies(resolve(includePaths(diagram), base_dir), dependencies, hashes);
+    return dependencies;
+}
+
+QByteArray IncludeResolver::dependencyHash(const QByteArray &diagram, const QString &base_dir)
+{
+    QStringList files;
+    QList<QByteArray> file_hashes;
+    addDependencies(resolve(includePaths(diagram), base_dir), files, file_hashes);
+    if (files.isEmpty()) {
+        return QByteArray();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    for (int i = 0; i < files.size(); ++i) {
+        // a missing file is part of it too, it may show up later
+        hash.addData(files[i].toUtf8());
+        hash.addData("\0", 1);
+        hash.addData(file_hashes[i]);
+    }
+    return hash.result();
+}
+
+QStringList IncludeResolver::includePaths(const QByteArray &text)
+{
+    QStringList paths;
+    foreach (const QByteArray& line, text.split('\n')) {
+        const QByteArray trimmed_line = line.trimmed();
+        if (!trimmed_line.startsWith(INCLUDE_PREFIX)) {
+            continue;
+        }
+        int space = 0;
+        while (space < trimmed_line.size() && trimmed_line[space] != ' ' && trimmed_line[space] != '\t') {
+            ++space;
+        }
+        if (!isIncludeDirective(trimmed_line.left(space))) {
+            continue;
+        }
+
+        QByteArray path = trimmed_line.mid(space).trimmed();
+        if (path.size() >= 2 && path.startsWith('"') && path.endsWith('"')) {
+            path = path.mid(1, path.size() - 2);
+        }
+        // <std/lib> is in plantuml.jar, and URLs are PlantUML's business
+        if (path.isEmpty() || path.startsWith('<') || path.contains("://")) {
+            continue;
+        }
+        const int suffix = path.indexOf('!');
+        if (suffix > 0) {
+            path = path.left(suffix);
+        }
+        paths << QString::fromUtf8(path);
+    }
+    return paths;
+}
+
+const IncludeResolver::FileEntry &IncludeResolver::entry(const QString &path)
+{
+    const QFileInfo info(path);
+    QHash<QString, FileEntry>::iterator it = m_files.find(path);
+    if (it != m_files.end() &&
+            it.value().modified == info.lastModified() && it.value().size == info.size() &&
+            it.value().modified.secsTo(it.value().read) > MODIFICATION_TIME_SLACK) {
+        return it.value();
+    }
+
+    FileEntry& file = m_files[path];
+    file.modified = info.lastModified();
+    file.size = info.size();
+    file.read = QDateTime::currentDateTime();
+    file.hash.clear();
+    file.includes.clear();
+
+    QFile content_file(path);
+    if (content_file.open(QIODevice::ReadOnly)) {
+        const QByteArray content = content_file.readAll();
+        file.hash = QCryptographicHash::hash(content, QCryptographicHash::Md5);
+        file.includes = resolve(includePaths(content), info.absolutePath());
+    }
+    return file;
+}
+
+void IncludeResolver::addDependencies(const QStringList &includes, QStringList &dependencies, QList<QByteArray> &hashes)
+{
+    foreach (const QString& path, includes) {
+        if (dependencies.contains(path)) {
+            continue; // included twice, or in a cycle
+        }
+        // copies: the entries may move while the nested ones are added
+        const FileEntry& file = entry(path);
+        const QStringList nested_includes = file.includes;
+        dependencies << path;
+        hashes << file.hash;
+        addDependencies(nested_includes, dependencies, hashes);
+    }
+}
+
+QStringList IncludeResolver::resolve(const QStringList &paths, const QString &base_dir)
+{
+    QStringList absolute_paths;
+    const QDir dir(base_dir);
+    foreach (const QString& path, paths) {
+        absolute_paths << QDir::cleanPath(dir.absoluteFilePath(path));
+    }
+    return absolute_paths;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,54 @@
+#ifndef INCLUDERESOLVER_H
+#define INCLUDERESOLVER_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+
+//------------------------------------------------------------------------------
+
+// The files a diagram pulls in with !include and !includesub, directly or
+// through other included files, so that its cache key changes with them. A
+// relative path is resolved from the directory of the file including it, or
+// from the working directory of PlantUML for the diagram itself. Every file
+// seen is remembered with its modification time and its own includes: it is
+// only read again once it changes, and then only the diagrams depending on it
+// get another key.
+class IncludeResolver
+{
+public:
+    IncludeResolver();
+
+    // the absolute paths, in the order PlantUML includes them
+    QStringList dependencies(const QByteArray& diagram, const QString& base_dir);
+    // changes whenever one of the dependencies does, empty without any
+    QByteArray dependencyHash(const QByteArray& diagram, const QString& base_dir);
+
+    // the local files included by this text, as written (without the
+    // !sub-part or !index suffix)
+    static QStringList includePaths(const QByteArray& text);
+
+private:
+    struct FileEntry
+    {
+        QDateTime modified;
+        qint64 size;
+        QDateTime read; //< when it was last read
+        QByteArray hash; //< of the content, empty if it can't be read
+        QStringList includes; //< absolute paths
+    };
+
+    const FileEntry& entry(const QString& path);
+    // the hashes of their contents are added in the same order, each file is
+    // only looked at once
+    void addDependencies(const QStringList& includes, QStringList& dependencies, QList<QByteArray>& hashes);
+    static QStringList resolve(const QStringList& paths, const QString& base_dir);
+
+    QHash<QString, FileEntry> m_files;
+};
+
+//------------------------------------------------------------------------------
+
+#endif // INCLUDERESOLVER_H
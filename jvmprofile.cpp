@@ -0,0 +1,195 @@
+#include "jvmprofile.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDebug>
+
+//------------------------------------------------------------------------------
+
+namespace {
+const QString ARCHIVE_PREFIX = "plantuml-";
+const QString ARCHIVE_SUFFIX = ".jsa";
+const QString PARTIAL_ARCHIVE_SUFFIX = ".part";
+
+// the central directory at the end of a jar lists the CRC of every entry, so
+// it changes with the content without reading the whole jar
+const qint64 JAR_TAIL_SIZE = 64 * 1024;
+
+// what a training run renders: the classes loaded for these end up in the
+// archive
+const QByteArray TRAINING_DIAGRAMS =
+        "@startuml\n"
+        "Alice -> Bob: request\n"
+        "Bob --> Alice: response\n"
+        "@enduml\n"
+        "@startuml\n"
+        "class Foo {\n  +bar(): int\n}\n"
+        "Foo <|-- Baz\n"
+        "@enduml\n"
+        "@startuml\n"
+        "start\n:step;\nif (test?) then (yes)\n  :other step;\nendif\nstop\n"
+        "@enduml\n";
+
+// valid for any JVM, unknown options are ignored rather than fatal
+QStringList startupOptions()
+{
+    QStringList options;
+    options << "-XX:+IgnoreUnrecognizedVMOptions"
+            << "-Djava.awt.headless=true"
+            // one GC thread and no heap resizing at startup: the renders are
+            // single threaded and small
+            << "-XX:+UseSerialGC"
+            << "-Xms64m"
+            << "-XX:-UsePerfData";
+    return options;
+}
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+JvmProfile::JvmProfile(QObject *parent)
+    : QObject(parent)
+    , m_enabled(true)
+    , m_training(0)
+{
+}
+
+JvmProfile::~JvmProfile()
+{
+    if (m_training) {
+        m_training->disconnect(this);
+        m_training->kill();
+        m_training->waitForFinished();
+        QFile::remove(m_trainingArchivePath);
+    }
+}
+
+QStringList JvmProfile::javaOptions(const QString &java_path, const QString &jar_path, bool short_lived)
+{
+    QStringList options;
+    if (!m_enabled) {
+        return options;
+    }
+
+    options << startupOptions();
+    if (short_lived) {
+        options << "-XX:TieredStopAtLevel=1";
+    }
+
+    const QString print = fingerprint(java_path, jar_path);
+    if (!print.isEmpty() && QFile::exists(archivePath(print))) {
+        options << "-Xshare:auto"
+                << QString("-XX:SharedArchiveFile=%1").arg(archivePath(print));
+    }
+    return options;
+}
+
+void JvmProfile::prepare(const QString &java_path, const QString &jar_path)
+{
+    if (!m_enabled || m_training || m_path.isEmpty()) {
+        return;
+    }
+
+    const QString print = fingerprint(java_path, jar_path);
+    if (print.isEmpty() || m_trained.contains(print) || QFile::exists(archivePath(print))) {
+        return;
+    }
+    m_trained << print;
+
+    if (!QDir().mkpath(m_path)) {
+        return;
+    }
+    m_trainingArchivePath = archivePath(print) + PARTIAL_ARCHIVE_SUFFIX;
+    QFile::remove(m_trainingArchivePath);
+
+    QStringList arguments;
+    arguments << startupOptions()
+              << QString("-XX:ArchiveClassesAtExit=%1").arg(m_trainingArchivePath)
+              << "-jar" << jar_path
+              << "-tsvg" << "-charset" << "UTF-8" << "-pipe";
+
+    m_training = new QProcess(this);
+    m_training->setWorkingDirectory(m_path);
+    connect(m_training, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(onTrainingFinished(int,QProcess::ExitStatus)));
+    connect(m_training, SIGNAL(error(QProcess::ProcessError)), this, SLOT(onTrainingError(QProcess::ProcessError)));
+
+    qDebug() << "making the class data sharing archive" << archivePath(print);
+    m_training->start(java_path, arguments);
+    // the archive is written when the JVM exits normally, once stdin is closed
+    m_training->write(TRAINING_DIAGRAMS);
+    m_training->closeWriteChannel();
+}
+
+QString JvmProfile::fingerprint(const QString &java_path, const QString &jar_path)
+{
+    QFileInfo java_info(java_path);
+    QFileInfo jar_info(jar_path);
+    if (!java_info.exists() || !jar_info.exists()) {
+        return QString();
+    }
+
+    // an archive only fits the JVM that made it
+    const QString cache_key = QString("%1|%2|%3|%4|%5")
+            .arg(java_info.canonicalFilePath())
+            .arg(java_info.lastModified().toString(Qt::ISODate))
+            .arg(jar_info.canonicalFilePath())
+            .arg(jar_info.size())
+            .arg(jar_info.lastModified().toString(Qt::ISODate));
+    QString print = m_fingerprints.value(cache_key);
+    if (!print.isEmpty()) {
+        return print;
+    }
+
+    QFile jar(jar_path);
+    if (!jar.open(QIODevice::ReadOnly)) {
+        return QString();
+    }
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(cache_key.section('|', 0, 1).toUtf8());
+    hash.addData(QByteArray::number(jar.size()));
+    jar.seek(qMax(qint64(0), jar.size() - JAR_TAIL_SIZE));
+    hash.addData(jar.readAll());
+
+    print = QString::fromLatin1(hash.result().toHex());
+    m_fingerprints.insert(cache_key, print);
+    return print;
+}
+
+QString JvmProfile::archivePath(const QString &fingerprint) const
+{
+    return QDir(m_path).absoluteFilePath(ARCHIVE_PREFIX + fingerprint + ARCHIVE_SUFFIX);
+}
+
+void JvmProfile::onTrainingFinished(int exit_code, QProcess::ExitStatus exit_status)
+{
+    endTraining(exit_status == QProcess::NormalExit && exit_code == 0);
+}
+
+void JvmProfile::onTrainingError(QProcess::ProcessError error)
+{
+    if (error == QProcess::FailedToStart) {
+        endTraining(false);
+    }
+}
+
+void JvmProfile::endTraining(bool success)
+{
+    m_training->deleteLater();
+    m_training = 0;
+
+    QString path = m_trainingArchivePath;
+    path.chop(PARTIAL_ARCHIVE_SUFFIX.size());
+    if (success && QFileInfo(m_trainingArchivePath).size() > 0 &&
+            QFile::rename(m_trainingArchivePath, path)) {
+        qDebug() << "class data sharing archive ready";
+        emit archiveReady(path);
+    } else {
+        // most likely a JVM without dynamic archives (before Java 13)
+        qDebug() << "no class data sharing archive made";
+        QFile::remove(m_trainingArchivePath);
+    }
+}
+
+//------------------------------------------------------------------------------
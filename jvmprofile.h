@@ -0,0 +1,65 @@
+#ifndef JVMPROFILE_H
+#define JVMPROFILE_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QProcess>
+
+//------------------------------------------------------------------------------
+
+// The java options that make PlantUML start faster. Besides a few startup
+// flags, a class data sharing (AppCDS) archive of the classes PlantUML loads
+// is made once for each pair of java and plantuml.jar, by a training run in
+// the background, and kept in path() under their fingerprint. Every JVM
+// started afterwards maps the archive instead of loading and verifying these
+// classes again. JVMs too old for some of the options just ignore them.
+class JvmProfile : public QObject
+{
+    Q_OBJECT
+public:
+    explicit JvmProfile(QObject* parent = 0);
+    virtual ~JvmProfile();
+
+    bool isEnabled() const { return m_enabled; }
+    void setEnabled(bool enabled) { m_enabled = enabled; }
+
+    const QString& path() const { return m_path; }
+    void setPath(const QString& path) { m_path = path; }
+
+    // Short lived processes (a new one per batch) are better off without the
+    // optimizing compiler. Empty when disabled.
+    QStringList javaOptions(const QString& java_path, const QString& jar_path, bool short_lived);
+    // starts the training run if this pair has no archive yet
+    void prepare(const QString& java_path, const QString& jar_path);
+
+    // empty if one of the files doesn't exist
+    QString fingerprint(const QString& java_path, const QString& jar_path);
+    QString archivePath(const QString& fingerprint) const;
+    bool isTraining() const { return m_training != 0; }
+
+signals:
+    void archiveReady(const QString& path);
+
+private slots:
+    void onTrainingFinished(int exit_code, QProcess::ExitStatus exit_status);
+    void onTrainingError(QProcess::ProcessError error);
+
+private:
+    void endTraining(bool success);
+
+    bool m_enabled;
+    QString m_path;
+    // the fingerprints already computed, by files and modification times
+    QHash<QString, QString> m_fingerprints;
+    // tried in this session, whatever the outcome
+    QSet<QString> m_trained;
+    QProcess* m_training;
+    QString m_trainingArchivePath;
+};
+
+//------------------------------------------------------------------------------
+
+#endif // JVMPROFILE_H
@@ -0,0 +1,148 @@
+#include "layoutcalibrator.h"
+#include "diagramsource.h"
+#include <QDebug>
+
+//------------------------------------------------------------------------------
+
+namespace {
+// each sample is measured this many times with each engine, in alternating
+// order, so that neither always runs right after the other
+const int ROUNDS = 2;
+// a sample taking longer is a failure of the engine, not a measure
+const int MEASURE_TIMEOUT = 30000; // in miliseconds
+const QString FORMAT = "svg";
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+LayoutCalibrator::LayoutCalibrator(QObject *parent)
+    : QObject(parent)
+    , m_worker(0)
+{
+}
+
+LayoutCalibrator::~LayoutCalibrator()
+{
+    stop();
+}
+
+void LayoutCalibrator::start(const RenderSettings &settings, const QList<QByteArray> &samples)
+{
+    stop();
+    m_measures.clear();
+    for (int engine = 0; engine < 2; ++engine) {
+        m_times[engine].clear();
+        m_failures[engine].clear();
+    }
+    m_choices.clear();
+
+    QList<QByteArray> diagrams;
+    foreach (const QByteArray& sample, samples) {
+        if (!draftDiagram(sample).isEmpty()) {
+            diagrams << sample;
+        }
+    }
+    if (diagrams.isEmpty()) {
+        emit finished();
+        return;
+    }
+
+    Measure warm_up = { QByteArray(), GraphvizEngine, diagrams.first() };
+    m_measures << warm_up;
+    warm_up.engine = SmetanaEngine;
+    m_measures << warm_up;
+    for (int round = 0; round < ROUNDS; ++round) {
+        foreach (const QByteArray& diagram, diagrams) {
+            Engine first = (round % 2 == 0) ? GraphvizEngine : SmetanaEngine;
+            Engine second = (first == GraphvizEngine) ? SmetanaEngine : GraphvizEngine;
+            Measure measure = { diagramKind(diagram), first, diagram };
+            m_measures << measure;
+            measure.engine = second;
+            m_measures << measure;
+        }
+    }
+
+    m_worker = new RenderWorker(this);
+    m_worker->setSettings(settings);
+    m_worker->setKeepRunning(true);
+    m_worker->setTimeout(MEASURE_TIMEOUT);
+    connect(m_worker, SIGNAL(jobFinished(RenderJob*)), this, SLOT(onJobFinished(RenderJob*)));
+    renderNext();
+}
+
+void LayoutCalibrator::stop()
+{
+    if (m_worker) {
+        // the queued job goes with the worker
+        m_worker->disconnect(this);
+        delete m_worker;
+        m_worker = 0;
+    }
+}
+
+QByteArray LayoutCalibrator::withEngine(const QByteArray &diagram, Engine engine)
+{
+    if (engine == SmetanaEngine) {
+        QByteArray draft = draftDiagram(diagram);
+        if (!draft.isEmpty()) {
+            return draft;
+        }
+    }
+    return diagram;
+}
+
+void LayoutCalibrator::onJobFinished(RenderJob *job)
+{
+    const qint64 elapsed = m_time.elapsed();
+    const Measure measure = m_measures.takeFirst();
+    if (!measure.kind.isEmpty()) {
+        if (job->hasError()) {
+            m_failures[measure.engine].insert(measure.kind);
+        } else {
+            m_times[measure.engine][measure.kind] += elapsed;
+        }
+    }
+
+    if (m_measures.isEmpty()) {
+        finish();
+    } else {
+        renderNext();
+    }
+}
+
+void LayoutCalibrator::renderNext()
+{
+    const Measure& measure = m_measures.first();
+    m_time.start();
+    m_worker->render(new RenderJob(QString("calibration-%1").arg(m_measures.size()),
+                                   withEngine(measure.diagram, measure.engine), FORMAT));
+}
+
+void LayoutCalibrator::finish()
+{
+    QSet<QByteArray> kinds = QSet<QByteArray>::fromList(m_times[GraphvizEngine].keys());
+    kinds.unite(QSet<QByteArray>::fromList(m_times[SmetanaEngine].keys()));
+    foreach (const QByteArray& kind, kinds) {
+        const bool graphviz_works = !m_failures[GraphvizEngine].contains(kind) &&
+                m_times[GraphvizEngine].contains(kind);
+        const bool smetana_works = !m_failures[SmetanaEngine].contains(kind) &&
+                m_times[SmetanaEngine].contains(kind);
+        if (graphviz_works && smetana_works) {
+            m_choices[kind] = (m_times[SmetanaEngine][kind] < m_times[GraphvizEngine][kind]) ?
+                        SmetanaEngine : GraphvizEngine;
+        } else if (graphviz_works || smetana_works) {
+            m_choices[kind] = graphviz_works ? GraphvizEngine : SmetanaEngine;
+        }
+        qDebug() << "layout of" << kind << "graphviz:" << m_times[GraphvizEngine].value(kind)
+                 << "ms, smetana:" << m_times[SmetanaEngine].value(kind) << "ms";
+    }
+
+    // the process isn't needed anymore, but this is called from one of its
+    // signals
+    m_worker->disconnect(this);
+    m_worker->deleteLater();
+    m_worker = 0;
+    emit finished();
+}
+
+//------------------------------------------------------------------------------
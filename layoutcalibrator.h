@@ -0,0 +1,73 @@
+#ifndef LAYOUTCALIBRATOR_H
+#define LAYOUTCALIBRATOR_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QElapsedTimer>
+#include "renderworker.h"
+
+//------------------------------------------------------------------------------
+
+// Finds out which layout engine renders each kind of diagram faster on this
+// machine: Graphviz, which costs a dot process per diagram, or PlantUML's own
+// Smetana, which runs in the JVM but does a poorer job on large diagrams. The
+// sample diagrams are rendered one at a time by a PlantUML process of its
+// own, with each engine in turn, after a first unmeasured render with each
+// engine to warm the JVM up. An engine that fails on a diagram is never
+// chosen for its kind.
+class LayoutCalibrator : public QObject
+{
+    Q_OBJECT
+public:
+    enum Engine { GraphvizEngine, SmetanaEngine };
+
+    explicit LayoutCalibrator(QObject* parent = 0);
+    virtual ~LayoutCalibrator();
+
+    bool isRunning() const { return m_worker != 0; }
+    // The samples that choose their layout engine themselves, or that aren't
+    // laid out by Graphviz at all, are skipped. finished() is emitted once
+    // the others were measured.
+    void start(const RenderSettings& settings, const QList<QByteArray>& samples);
+    void stop();
+
+    // the faster engine for each kind of diagram (see diagramKind()) that
+    // one of the engines managed to render
+    const QHash<QByteArray, Engine>& choices() const { return m_choices; }
+
+    // the diagram as it is rendered by this engine
+    static QByteArray withEngine(const QByteArray& diagram, Engine engine);
+
+signals:
+    void finished();
+
+private slots:
+    void onJobFinished(RenderJob* job);
+
+private:
+    struct Measure
+    {
+        QByteArray kind; //< empty for a warm-up render
+        Engine engine;
+        QByteArray diagram;
+    };
+
+    void renderNext();
+    void finish();
+
+    RenderWorker* m_worker;
+    // still to be rendered, the head is rendering
+    QList<Measure> m_measures;
+    QElapsedTimer m_time;
+    // the total time of each kind, and the kinds it failed on, by engine
+    QHash<QByteArray, qint64> m_times[2];
+    QSet<QByteArray> m_failures[2];
+    QHash<QByteArray, Engine> m_choices;
+};
+
+//------------------------------------------------------------------------------
+
+#endif // LAYOUTCALIBRATOR_H
@@ -2,6 +2,7 @@
 #include <QFileInfo>
 #include <QDebug>
 #include "mainwindow.h"
+#include "dotmemo.h"
 
 namespace {
 const char* APPLICATION_NAME = "PlantUML Editor";
@@ -39,6 +40,12 @@ bool singleInstanceModeRequested(QStringList& options) {
 
 int main(int argc, char *argv[])
 {
+    if (DotMemo::isShim()) {
+        // started by PlantUML as its dot
+        QCoreApplication a(argc, argv);
+        return DotMemo::runShim(a.arguments().mid(1));
+    }
+
     QCoreApplication::setOrganizationName(ORGANIZATION_NAME);
     QCoreApplication::setOrganizationDomain(ORGANIZATION_DOMAIN);
     QCoreApplication::setApplicationName(APPLICATION_NAME);
@@ -7,6 +7,15 @@
 #include "recentdocuments.h"
 #include "utils.h"
 #include "textedit.h"
+#include "renderpool.h"
+#include "diagramsource.h"
+#include "refreshscheduler.h"
+#include "jvmprofile.h"
+#include "svgrasterizer.h"
+#include "layoutcalibrator.h"
+#include "dotmemo.h"
+#include "includeresolver.h"
+#include "documenthash.h"
 
 #include <QtGui>
 #include <QtSvg>
@@ -24,7 +33,55 @@ const QString EXPORT_TO_MENU_FORMAT_STRING = QObject::tr("Export to %1");
 const QString EXPORT_TO_LABEL_FORMAT_STRING = QObject::tr("Export to: %1");
 const QString AUTOREFRESH_STATUS_LABEL = QObject::tr("Auto-refresh");
 const QString CACHE_SIZE_FORMAT_STRING = QObject::tr("Cache: %1");
+const QString JVM_PROFILE_DIR = "jvm"; // in the default cache location
+const QString DOT_MEMO_DIR = "dot"; // in the default cache location
+// the generations of the cache are named by this many digits of their hash
+const int CACHE_GENERATION_LENGTH = 8;
+// changed whenever the editor renders the same diagrams differently
+const QByteArray RENDER_FLAGS_VERSION = "1";
+// changed whenever the keys of the diagrams are made out of them differently
+const QByteArray DIAGRAM_KEY_VERSION = "lines-1";
+const qint64 DOT_MEMO_MAX_SIZE = 20 * 1024 * 1024; // in bytes
+const int DOT_MEMO_PRUNE_AGE = 60 * 60; // in seconds, older layouts are unused
+// found in the PATH, when no Graphviz is set in the preferences
+const QString DOT_PROGRAM = "dot";
+const QString DOT_MEMO_FORMAT_STRING = QObject::tr("Dot: %1 reused, %2 run");
+// the values of SETTINGS_LAYOUT_ENGINE
+const int AUTOMATIC_LAYOUT = 0;
+const int GRAPHVIZ_LAYOUT = 1;
+const int SMETANA_LAYOUT = 2;
+const QString GRAPHVIZ_LAYOUT_NAME = "graphviz";
+const QString SMETANA_LAYOUT_NAME = "smetana";
+const QString RENDER_POOL_FORMAT_STRING = QObject::tr("Workers: %1/%2");
 const QSize ASSISTANT_ICON_SIZE(128, 128);
+// Stands in the cache for the image of a diagram that took too long to
+// render, followed by the error: it isn't rendered again until a forced
+// refresh, when it would most likely hang again.
+const QByteArray TIMED_OUT_MARKER = "plantumlqeditor-render-timed-out\n";
+
+// the resolution of the PNG images rendered by PlantUML itself
+const int DEFAULT_PNG_DPI = 96;
+// smaller diagrams are rendered fast enough without a draft first
+const int DRAFT_MIN_SIZE = 2048; // in bytes
+// the keys of the drafts are "<digest>.draft.<format>"
+const QString DRAFT_KEY_TAG = "draft";
+
+AbstractFileCacheItem* newFileCacheItem(const QString& path, const QString& key, int cost, const QDateTime& date_time, QObject* parent)
+{
+    return new FileCacheItem(path, key, cost, date_time, parent);
+}
+
+// the keys are "<digest>.<suffix>", the same diagram in another format only
+// differs by its suffix
+QString keyWithSuffix(const QString& key, const QString& suffix)
+{
+    return key.section('.', 0, 0) + '.' + suffix;
+}
+
+bool isDraftKey(const QString& key)
+{
+    return key.section('.', 1, 1) == DRAFT_KEY_TAG;
+}
 
 QIcon iconFromSvg(QSize size, const QString& path)
 {
@@ -79,8 +136,17 @@ QListWidget* newAssistantListWidget(const QSize& icon_size, QWidget* parent)
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , m_hasValidPaths(false)
-    , m_process(0)
     , m_currentImageFormat(SvgFormat)
+    , m_derivePng(SETTINGS_DERIVE_PNG_DEFAULT)
+    , m_pngDpi(SETTINGS_PNG_DPI_DEFAULT)
+    , m_prepareOtherFormat(SETTINGS_PREPARE_OTHER_FORMAT_DEFAULT)
+    , m_draftPreview(SETTINGS_DRAFT_PREVIEW_DEFAULT)
+    , m_memoizeDot(SETTINGS_MEMOIZE_DOT_DEFAULT)
+    , m_dotMemo(0)
+    , m_includeResolver(new IncludeResolver)
+    , m_documentHash(DocumentHash::create())
+    , m_documentDigest(0)
+    , m_layoutEngine(SETTINGS_LAYOUT_ENGINE_DEFAULT)
     , m_needsRefresh(false)
 {
     setWindowTitle(TITLE_FORMAT_STRING
@@ -89,12 +155,25 @@ MainWindow::MainWindow(QWidget *parent)
                    );
 
     m_cache = new FileCache(0, this);
+    connect(m_cache, SIGNAL(staleItemsCollected()), this, SLOT(updateCacheSizeInfo()));
 
     m_recentDocuments = new RecentDocuments(MAX_RECENT_DOCUMENT_SIZE, this);
     connect(m_recentDocuments, SIGNAL(recentDocument(QString)), this, SLOT(onRecentDocumentsActionTriggered(QString)));
 
-    m_autoRefreshTimer = new QTimer(this);
-    connect(m_autoRefreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+    m_renderPool = new RenderPool(SETTINGS_RENDER_WORKERS_DEFAULT, this);
+    m_renderPool->setOutputWriter(m_cache->writer());
+    connect(m_renderPool, SIGNAL(jobFinished(RenderJob*)), this, SLOT(refreshFinished(RenderJob*)));
+
+    m_refreshScheduler = new RefreshScheduler(this);
+    connect(m_refreshScheduler, SIGNAL(triggered()), this, SLOT(refresh()));
+
+    m_jvmProfile = new JvmProfile(this);
+
+    m_rasterizer = new SvgRasterizer(this);
+    connect(m_rasterizer, SIGNAL(finished(QString,QByteArray)), this, SLOT(onSvgRasterized(QString,QByteArray)));
+
+    m_layoutCalibrator = new LayoutCalibrator(this);
+    connect(m_layoutCalibrator, SIGNAL(finished()), this, SLOT(onLayoutCalibrated()));
 
     m_imageFormatNames[SvgFormat] = "svg";
     m_imageFormatNames[PngFormat] = "png";
@@ -131,6 +210,14 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+    // its workers may still remove files with the writer of the cache
+    delete m_renderPool;
+    if (m_dotMemo) {
+        m_dotMemo->resetCounts();
+    }
+    delete m_dotMemo;
+    delete m_includeResolver;
+    delete m_documentHash;
 }
 
 void MainWindow::newDocument()
@@ -140,8 +227,9 @@ void MainWindow::newDocument()
     }
 
     m_documentPath.clear();
+    m_dependencyHashes.clear();
     m_exportPath.clear();
-    m_cachedImage.clear();
+    m_cachedImages.clear();
     m_exportImageAction->setText(EXPORT_TO_MENU_FORMAT_STRING.arg(""));
     m_exportPathLabel->setText(EXPORT_TO_LABEL_FORMAT_STRING.arg(""));
     m_exportPathLabel->setEnabled(false);
@@ -160,9 +248,7 @@ void MainWindow::newDocument()
 
 void MainWindow::copyImage()
 {
-    QPixmap pixmap;
-    pixmap.loadFromData(m_cachedImage);
-    QApplication::clipboard()->setPixmap(pixmap);
+    QApplication::clipboard()->setImage(m_imageWidget->toImage());
     qDebug() << "Image copy into Clipboard";
 }
 
@@ -196,62 +282,234 @@ void MainWindow::about()
                        );
 }
 
-QString MainWindow::makeKeyForDocument(QByteArray current_document)
+QString MainWindow::makeKeyForDiagram(const DocumentLines::Diagram &diagram)
 {
+    m_documentHash->reset();
+    m_documentHash->addData(diagram.digest);
+    m_documentHash->addData(usesSmetana(diagram.kind) ? SMETANA_LAYOUT_NAME.toLatin1() : GRAPHVIZ_LAYOUT_NAME.toLatin1());
+    if (diagram.hasIncludes) {
+        // the files they include are only looked at by refresh()
+        QHash<QByteArray, QByteArray>::const_iterator it = m_dependencyHashes.constFind(diagram.digest);
+        if (it == m_dependencyHashes.constEnd()) {
+            return QString();
+        }
+        m_documentHash->addData(*it);
+    }
     QString key = QString("%1.%2")
-            .arg(QString::fromUtf8(QCryptographicHash::hash(current_document, QCryptographicHash::Md5).toHex()))
-            .arg(m_imageFormatNames[m_currentImageFormat])
+            .arg(QString::fromLatin1(m_documentHash->result().toHex()))
+            .arg(keySuffix(m_currentImageFormat))
             ;
 
+    return m_cache->keyInGeneration(key);
+}
+
+QString MainWindow::keySuffix(ImageFormat format) const
+{
+    // derived images of another resolution are other images
+    if (format == PngFormat && m_derivePng && m_pngDpi != DEFAULT_PNG_DPI) {
+        return QString("%1dpi.%2").arg(m_pngDpi).arg(m_imageFormatNames[format]);
+    }
+    return m_imageFormatNames[format];
+}
+
+QString MainWindow::renderKeyFor(const QString &key) const
+{
+    if (m_derivePng && m_currentImageFormat == PngFormat) {
+        return keyWithSuffix(key, keySuffix(SvgFormat));
+    }
     return key;
 }
 
-bool MainWindow::refreshFromCache()
+QString MainWindow::diagramKeyFor(const QString &render_key) const
+{
+    if (m_derivePng && m_currentImageFormat == PngFormat && render_key.endsWith(keySuffix(SvgFormat))) {
+        return keyWithSuffix(render_key, keySuffix(PngFormat));
+    }
+    return render_key;
+}
+
+QString MainWindow::draftKeyFor(const QString &key) const
+{
+    return keyWithSuffix(key, DRAFT_KEY_TAG + '.' + m_imageFormatNames[m_currentImageFormat]);
+}
+
+QString MainWindow::diagramKeyForDraft(const QString &draft_key) const
+{
+    if (!draft_key.endsWith('.' + m_imageFormatNames[m_currentImageFormat])) {
+        return QString(); // rendered for the other format
+    }
+    return keyWithSuffix(draft_key, keySuffix(m_currentImageFormat));
+}
+
+QStringList MainWindow::makeKeysForDiagrams(const QList<DocumentLines::Diagram> &diagrams)
+{
+    QStringList keys;
+    foreach (const DocumentLines::Diagram& diagram, diagrams) {
+        keys << makeKeyForDiagram(diagram);
+    }
+    return keys;
+}
+
+QByteArray MainWindow::imageFromCache(const QString &key) const
 {
     if (m_useCache) {
-        QByteArray current_document = m_editor->toPlainText().toUtf8().trimmed();
-        if (current_document.isEmpty()) {
-            qDebug() << "empty document. skipping...";
-            return true;
+        // it may not be written to disk yet
+        const QByteArray image = m_cache->itemData(key);
+        if (!image.isEmpty()) {
+            if (image.startsWith(TIMED_OUT_MARKER)) {
+                m_timedOutKeys << key;
+            }
+            // the images in use are the last ones to make room for others
+            m_cache->touch(key);
+            return image;
         }
+    }
+    return QByteArray();
+}
 
-        switch(m_currentImageFormat) {
-        case SvgFormat:
-            m_imageWidget->setMode(PreviewWidget::SvgMode);
-            break;
-        case PngFormat:
-            m_imageWidget->setMode(PreviewWidget::PngMode);
-            break;
+bool MainWindow::findDiagramImages(const QStringList &keys, QMap<QString, QByteArray> &images) const
+{
+    bool complete = true;
+    foreach (const QString& key, keys) {
+        if (images.contains(key)) {
+            continue;
+        }
+        // the diagrams which didn't change since the last refresh are already here
+        QByteArray image = m_diagramImages.value(key);
+        if (image.isEmpty()) {
+            image = imageFromCache(key);
         }
+        if (image.isEmpty()) {
+            complete = false;
+        } else {
+            images[key] = image;
+        }
+    }
+    return complete;
+}
 
-        QString key = makeKeyForDocument(current_document);
-        // try the cache first
-        const FileCacheItem* item = qobject_cast<const FileCacheItem*>(m_cache->item(key));
-        if (item) {
-            QFile file(item->path());
-            if (file.open(QFile::ReadOnly)) {
-                QByteArray cache_image = file.readAll();
-                if (cache_image.size()) {
-                    m_cachedImage = cache_image;
-                    m_imageWidget->load(m_cachedImage);
-                    statusBar()->showMessage(tr("Chache hit: %1").arg(key), STATUSBAR_TIMEOUT);
-                    m_needsRefresh = false;
-                    return true;
-                }
-            }
+void MainWindow::setPreviewMode()
+{
+    switch(m_currentImageFormat) {
+    case SvgFormat:
+        m_imageWidget->setMode(PreviewWidget::SvgMode);
+        break;
+    case PngFormat:
+        m_imageWidget->setMode(PreviewWidget::PngMode);
+        break;
+    }
+}
+
+bool MainWindow::showDiagramImages()
+{
+    int timed_out_count = 0;
+    m_cachedImages.clear();
+    foreach (const QString& key, m_diagramKeys) {
+        QByteArray image = m_diagramImages.value(key);
+        if (image.startsWith(TIMED_OUT_MARKER)) {
+            image.clear();
+            ++timed_out_count;
         }
+        m_cachedImages << image;
     }
+    m_imageWidget->load(m_cachedImages);
 
-    return false;
+    if (timed_out_count > 0) {
+        statusBar()->showMessage(tr("%1 diagrams timed out earlier, use Refresh to try them again").arg(timed_out_count));
+        return false;
+    }
+    return true;
 }
 
-void MainWindow::refresh(bool forced)
+void MainWindow::showCachedDiagrams(const QStringList &keys, const QMap<QString, QByteArray> &images)
+{
+    supersedeRenderJobs();
+    m_diagramKeys = keys;
+    m_diagramSources.clear(); // nothing was rendered
+    m_diagramImages = images;
+    setPreviewMode();
+    if (showDiagramImages()) {
+        statusBar()->showMessage(tr("Chache hit: %1").arg(keys.size() == 1 ? keys.first() : tr("%1 diagrams").arg(keys.size())),
+                                 STATUSBAR_TIMEOUT);
+    }
+    m_needsRefresh = false;
+}
+
+bool MainWindow::refreshFromCache()
+{
+    // the text of the document isn't needed, its digest is kept up to date
+    DocumentLines& lines = m_documentDigest->lines();
+    if (lines.isBlank()) {
+        qDebug() << "empty document. skipping...";
+        return true;
+    }
+
+    // with the generation and the includes as of the last refresh, nothing
+    // outside of the document is looked at while typing
+    QStringList keys = makeKeysForDiagrams(lines.diagrams());
+    QMap<QString, QByteArray> images;
+    if (keys.isEmpty() || keys.contains(QString()) || !findDiagramImages(keys, images)) {
+        return false;
+    }
+    showCachedDiagrams(keys, images);
+    return true;
+}
+
+bool MainWindow::usesSmetana(const QByteArray &kind) const
 {
-    if (m_process) {
-        qDebug() << "still processing previous refresh. skipping...";
+    return m_layoutEngine == SMETANA_LAYOUT ||
+            (m_layoutEngine == AUTOMATIC_LAYOUT &&
+             m_layoutChoices.value(kind, LayoutCalibrator::GraphvizEngine) == LayoutCalibrator::SmetanaEngine);
+}
+
+QList<QByteArray> MainWindow::diagramsToRender(const QList<DocumentLines::Diagram> &diagrams) const
+{
+    QList<QByteArray> texts;
+    foreach (const DocumentLines::Diagram& diagram, diagrams) {
+        const QByteArray text = m_documentDigest->lines().text(diagram);
+        texts << (usesSmetana(diagram.kind) ? LayoutCalibrator::withEngine(text, LayoutCalibrator::SmetanaEngine) : text);
+    }
+    return texts;
+}
+
+void MainWindow::calibrateLayout()
+{
+    if (m_layoutEngine != AUTOMATIC_LAYOUT || m_layoutCalibrator->isRunning() || m_calibrationSamples.isEmpty()) {
         return;
     }
 
+    // measured again whenever java, plantuml.jar or dot change, and without
+    // the memo of dot, which would serve the second round
+    RenderSettings settings = renderSettings();
+    settings.graphizPath = m_useCustomGraphiz ? m_graphizPath : QString();
+    settings.environment.clear();
+    const QString setup = m_jvmProfile->fingerprint(m_javaPath, m_plantUmlPath) + ' ' + settings.graphizPath;
+    if (setup == m_layoutChoicesSetup) {
+        return;
+    }
+    m_calibratingSetup = setup;
+    m_layoutCalibrator->start(settings, m_calibrationSamples);
+}
+
+void MainWindow::onLayoutCalibrated()
+{
+    m_layoutChoices.clear();
+    QStringList engines;
+    const QHash<QByteArray, LayoutCalibrator::Engine>& choices = m_layoutCalibrator->choices();
+    foreach (const QByteArray& kind, choices.keys()) {
+        const LayoutCalibrator::Engine engine = choices.value(kind);
+        m_layoutChoices[kind] = engine;
+        engines << QString("%1: %2").arg(QString(kind)).arg(engine == LayoutCalibrator::SmetanaEngine ? tr("Smetana") : tr("Graphviz"));
+    }
+    m_layoutChoicesSetup = m_calibratingSetup;
+    // used from the next refresh on
+    if (!engines.isEmpty()) {
+        statusBar()->showMessage(tr("Fastest layout engines: %1").arg(engines.join(", ")), STATUSBAR_TIMEOUT);
+    }
+}
+
+void MainWindow::refresh(bool forced)
+{
     if (!m_needsRefresh && !forced) {
         return;
     }
@@ -262,55 +520,124 @@ void MainWindow::refresh(bool forced)
         return;
     }
 
-    if (!forced && refreshFromCache()) {
+    DocumentLines& lines = m_documentDigest->lines();
+    if (lines.isBlank()) {
+        qDebug() << "empty document. skipping...";
         return;
     }
 
-    QByteArray current_document = m_editor->toPlainText().toUtf8().trimmed();
-    if (current_document.isEmpty()) {
-        qDebug() << "empty document. skipping...";
+    const QList<DocumentLines::Diagram> document_diagrams = lines.diagrams();
+    if (document_diagrams.isEmpty()) {
+        qDebug() << "no diagram in document. skipping...";
+        return;
+    }
+    updateCacheGeneration();
+    updateDependencyHashes(document_diagrams);
+    QStringList keys = makeKeysForDiagrams(document_diagrams);
+
+    // only the diagrams which changed are rendered again
+    QMap<QString, QByteArray> images;
+    if (!forced && findDiagramImages(keys, images)) {
+        showCachedDiagrams(keys, images);
         return;
     }
     m_needsRefresh = false;
+    // the text of the diagrams is only taken out of the editor to be rendered
+    const QList<QByteArray> diagrams = diagramsToRender(document_diagrams);
 
-    switch(m_currentImageFormat) {
-    case SvgFormat:
-        m_imageWidget->setMode(PreviewWidget::SvgMode);
-        break;
-    case PngFormat:
-        m_imageWidget->setMode(PreviewWidget::PngMode);
-        break;
+    QStringList render_keys;
+    foreach (const QString& key, keys) {
+        render_keys << renderKeyFor(key);
     }
-
-    QString key = makeKeyForDocument(current_document);
-
-    statusBar()->showMessage(tr("Refreshing..."));
-
-    QStringList arguments;
-
-    arguments << "-jar" << m_plantUmlPath
-              << QString("-t%1").arg(m_imageFormatNames[m_currentImageFormat]);
-    if (m_useCustomGraphiz) {
-        arguments << "-graphizdot" << m_graphizPath;
+    supersedeRenderJobs(render_keys);
+    // the images of the previous refresh in the other format aren't wanted
+    // anymore, unless they are the ones to show now
+    foreach (RenderJob* job, m_speculativeJobs) {
+        if (!render_keys.contains(job->key()) && m_renderPool->cancel(job)) {
+            m_speculativeJobs.remove(job->key());
+        }
+    }
+    foreach (const QString& key, m_rasterKeys) {
+        if (!keys.contains(key)) {
+            m_rasterKeys.remove(key); // its image only goes to the cache
+        }
+    }
+    foreach (RenderJob* job, m_draftJobs) {
+        if (!keys.contains(diagramKeyForDraft(job->key()))) {
+            m_renderPool->cancel(job); // or it only goes to the cache
+            m_draftJobs.remove(job->key());
+        }
+    }
+    foreach (const QString& key, m_draftImages.keys()) {
+        if (!keys.contains(key) || images.contains(key)) {
+            m_draftImages.remove(key);
+        }
+    }
+    // the SVG images just shown are enough for the PNG ones
+    const QMap<QString, QByteArray> previous_images = m_diagramImages;
+    m_diagramKeys = keys;
+    m_diagramSources = diagrams;
+    m_diagramImages = images;
+    m_renderErrors.clear();
+    m_renderDiagnostics.clear();
+    setPreviewMode();
+
+    m_jvmProfile->prepare(m_javaPath, m_plantUmlPath);
+    m_renderPool->setSettings(renderSettings());
+    for (int i = 0; i < diagrams.size(); ++i) {
+        const QString& key = keys[i];
+        const QString& render_key = render_keys[i];
+        if (images.contains(key) || m_renderJobs.contains(render_key) || m_rasterKeys.contains(key)) {
+            continue; // unchanged, or already being rendered
+        }
+        if (render_key != key && !forced) {
+            QByteArray svg = previous_images.value(render_key);
+            if (svg.isEmpty()) {
+                svg = imageFromCache(render_key);
+            }
+            if (!svg.isEmpty()) {
+                deriveDiagramImage(key, svg);
+                continue;
+            }
+        }
+        if (m_draftPreview) {
+            startDraft(key, diagrams[i]);
+        }
+        RenderJob* job = new RenderJob(render_key, diagrams[i],
+                                       m_imageFormatNames[render_key == key ? m_currentImageFormat : SvgFormat]);
+        if (m_useCache) {
+            job->setOutputPath(m_cache->partialItemPath(render_key)); // written while it's rendered
+        }
+        m_renderJobs[render_key] = job;
+        m_renderPool->render(job);
     }
-    arguments << "-charset" << "UTF-8" << "-pipe";
-
-    m_lastKey = key;
-    m_process = new QProcess(this);
-
-    QFileInfo fi(m_documentPath);
-    m_process->setWorkingDirectory(fi.absolutePath());
 
-    m_process->start(m_javaPath, arguments);
-    if (!m_process->waitForStarted()) {
-        qDebug() << "refresh subprocess failed to start";
+    if (m_renderJobs.isEmpty() && m_rasterKeys.isEmpty()) {
+        finishRefresh(); // only timed out diagrams were missing
         return;
     }
+    if (!m_draftImages.isEmpty()) {
+        showDraftImages();
+        return;
+    }
+    statusBar()->showMessage(tr("Refreshing %1 of %2 diagrams...").arg(m_renderJobs.size() + m_rasterKeys.size()).arg(keys.size()));
+}
 
-    connect(m_process, SIGNAL(finished(int)), this, SLOT(refreshFinished()));
-
-    m_process->write(current_document);
-    m_process->closeWriteChannel();
+void MainWindow::supersedeRenderJobs(const QStringList &keep_keys)
+{
+    foreach (RenderJob* job, m_renderJobs) {
+        if (keep_keys.contains(job->key())) {
+            continue;
+        }
+        // drop the refresh if it hasn't started yet, otherwise let it finish:
+        // its image only goes to the cache
+        if (m_renderPool->cancel(job)) {
+            qDebug() << "cancelled stale refresh" << job->key();
+        } else {
+            qDebug() << "superseded refresh still in flight" << job->key();
+        }
+        m_renderJobs.remove(job->key());
+    }
 }
 
 void MainWindow::updateCacheSizeInfo()
@@ -320,6 +647,57 @@ void MainWindow::updateCacheSizeInfo()
                                   tr("NO CACHE"));
 }
 
+void MainWindow::updateCacheGeneration()
+{
+    // another plantuml.jar, java or dot may draw the same diagrams differently
+    const QString renderer = m_jvmProfile->fingerprint(m_javaPath, m_plantUmlPath);
+    if (renderer.isEmpty()) {
+        return; // nothing renders anyway
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(renderer.toUtf8());
+    hash.addData("\n", 1);
+    if (m_useCustomGraphiz) {
+        const QFileInfo dot_info(m_graphizPath);
+        hash.addData(QString("%1 %2 %3")
+                     .arg(dot_info.absoluteFilePath())
+                     .arg(dot_info.size())
+                     .arg(dot_info.lastModified().toString(Qt::ISODate)).toUtf8());
+    }
+    hash.addData("\n", 1);
+    hash.addData(RENDER_FLAGS_VERSION);
+    // the keys made by another hash are stale, and collected in the background
+    hash.addData("\n", 1);
+    hash.addData(m_documentHash->name());
+    hash.addData("\n", 1);
+    hash.addData(DIAGRAM_KEY_VERSION);
+    m_cache->setGeneration(QString::fromLatin1(hash.result().toHex().left(CACHE_GENERATION_LENGTH)));
+}
+
+void MainWindow::updateDependencyHashes(const QList<DocumentLines::Diagram> &diagrams)
+{
+    // the others are dropped, their files may have changed since
+    QHash<QByteArray, QByteArray> hashes;
+    foreach (const DocumentLines::Diagram& diagram, diagrams) {
+        if (diagram.hasIncludes && !hashes.contains(diagram.digest)) {
+            // the only diagrams read again, the files they include are
+            // resolved from the working directory of PlantUML
+            const QByteArray text = m_documentDigest->lines().text(diagram);
+            hashes[diagram.digest] = m_includeResolver->dependencyHash(text, QFileInfo(m_documentPath).absolutePath());
+        }
+    }
+    m_dependencyHashes = hashes;
+}
+
+void MainWindow::updateDotMemoInfo()
+{
+    m_dotMemoLabel->setVisible(m_memoizeDot);
+    if (m_memoizeDot) {
+        m_dotMemoLabel->setText(DOT_MEMO_FORMAT_STRING.arg(m_dotMemo->hits()).arg(m_dotMemo->misses()));
+    }
+}
+
 void MainWindow::focusAssistant()
 {
     QListWidget* widget = qobject_cast<QListWidget*>(m_assistantToolBox->currentWidget());
@@ -331,40 +709,257 @@ void MainWindow::focusAssistant()
     }
 }
 
-void MainWindow::refreshFinished()
+void MainWindow::refreshFinished(RenderJob* job)
 {
-//    qDebug() << "Program:" << m_process->program();
-//    for (auto arg : m_process->arguments()) {
-//        qDebug() << arg.toLatin1().constData();
-//    }
-//    qDebug() << "Proc exit:" << m_process->exitCode()
-//             << "error" << m_process->error()
-//             << m_process->errorString();
-    if (m_process->exitCode() != 0) {
-        QString errorMessage = m_process->readAllStandardError();
-        QMessageBox::critical(this, tr("Error"),
-                              errorMessage,
-                              QMessageBox::Ok);
-        statusBar()->showMessage(errorMessage, STATUSBAR_TIMEOUT);
+    if (isDraftKey(job->key())) {
+        draftFinished(job);
+        return;
+    }
+    if (m_speculativeJobs.value(job->key()) == job) {
+        m_speculativeJobs.remove(job->key());
+    }
+    // a superseded diagram isn't shown, but its image is still worth caching
+    const bool superseded = (m_renderJobs.value(job->key()) != job);
+    if (!superseded) {
+        m_renderJobs.remove(job->key());
+    }
+
+    // the key of the image shown, which may be made out of the one rendered
+    const QString key = diagramKeyFor(job->key());
+    if (job->hasError()) {
+        if (job->timedOut()) {
+            const QByteArray timed_out = TIMED_OUT_MARKER + job->errorString().toUtf8();
+            if (m_useCache && m_cache) {
+                m_cache->addItem(timed_out, job->key(), newFileCacheItem);
+                m_timedOutKeys << job->key();
+                updateCacheSizeInfo();
+            }
+            if (!superseded) {
+                m_diagramImages[key] = timed_out;
+            }
+        }
+        if (superseded) {
+            return; // the newer revision will report its own errors
+        }
+        if (job->timedOut()) {
+            // the JVM messages and threads are too long for the message itself
+            m_renderErrors << job->errorString().section('\n', 0, 0);
+            m_renderDiagnostics << job->errorString();
+        } else {
+            m_renderErrors << job->errorString();
+        }
+    } else {
+        // a timed out item was read when it was shown, its key tells it apart
+        // without reading it again
+        if (m_useCache && m_cache && m_cache->hasItem(job->key()) && !m_timedOutKeys.contains(job->key())) {
+            // it waited for another job with the same key, already cached
+            if (!job->outputPath().isEmpty()) {
+                m_cache->removeFile(job->outputPath()); // once it's written
+            }
+        } else if (m_useCache && m_cache) {
+            // the worker already queued the image for the disk, if it had any
+            m_timedOutKeys.remove(job->key());
+            if (job->outputPath().isEmpty()) {
+                m_cache->addItem(job->output(), job->key(), newFileCacheItem);
+            } else {
+                m_cache->addPartialItem(job->outputPath(), job->key(), job->output(), newFileCacheItem);
+            }
+            updateCacheSizeInfo();
+        }
+        if (!superseded) {
+            if (key != job->key()) {
+                deriveDiagramImage(key, job->output());
+            } else {
+                m_diagramImages[key] = job->output();
+            }
+        }
+    }
+
+    if (superseded || !m_renderJobs.isEmpty() || !m_rasterKeys.isEmpty()) {
+        return; // the preview is updated once all the diagrams are there
+    }
+    finishRefresh();
+}
+
+void MainWindow::onSvgRasterized(const QString &key, const QByteArray &png)
+{
+    m_speculativeRasterKeys.remove(key);
+    if (png.isEmpty()) {
+        qDebug() << "can't make a PNG image for" << key;
+    } else if (m_useCache && m_cache) {
+        m_cache->addItem(png, key, newFileCacheItem);
+        updateCacheSizeInfo();
+    }
+
+    if (!m_rasterKeys.remove(key)) {
+        return; // superseded
+    }
+    if (png.isEmpty()) {
+        m_renderErrors << tr("Can't convert the SVG image to PNG");
+    } else {
+        m_diagramImages[key] = png;
+    }
+
+    if (m_renderJobs.isEmpty() && m_rasterKeys.isEmpty()) {
+        finishRefresh();
+    }
+}
+
+void MainWindow::deriveDiagramImage(const QString &key, const QByteArray &svg)
+{
+    if (svg.startsWith(TIMED_OUT_MARKER)) {
+        m_diagramImages[key] = svg; // the SVG image is missing as well
         return;
     }
-    m_cachedImage = m_process->readAll();
-//    qDebug() << "Image size" << m_cachedImage.size();
-    m_imageWidget->load(m_cachedImage);
-    m_process->deleteLater();
-    m_process = 0;
+    m_rasterKeys << key;
+    m_rasterizer->rasterize(key, svg);
+}
+
+QByteArray MainWindow::derivedPng(const QString &key, const QByteArray &svg)
+{
+    // without derived images, the cached ones come from PlantUML
+    const QString png_key = keyWithSuffix(key, keySuffix(PngFormat));
+    QByteArray png = imageFromCache(png_key);
+    if (png.isEmpty() && !svg.isEmpty()) {
+        png = SvgRasterizer::toPng(svg, m_pngDpi);
+        if (!png.isEmpty() && m_derivePng && m_useCache && m_cache) {
+            m_cache->addItem(png, png_key, newFileCacheItem);
+            updateCacheSizeInfo();
+        }
+    }
+    return png;
+}
+
+void MainWindow::startDraft(const QString &key, const QByteArray &diagram)
+{
+    if (diagram.size() < DRAFT_MIN_SIZE || m_draftImages.contains(key)) {
+        return;
+    }
+    const QByteArray draft = draftDiagram(diagram);
+    const QString draft_key = draftKeyFor(key);
+    if (draft.isEmpty() || m_draftJobs.contains(draft_key)) {
+        return;
+    }
+
+    const QByteArray image = imageFromCache(draft_key);
+    if (!image.isEmpty()) {
+        m_draftImages[key] = image;
+        return;
+    }
+    RenderJob* job = new RenderJob(draft_key, draft, m_imageFormatNames[m_currentImageFormat]);
+    if (m_useCache) {
+        job->setOutputPath(m_cache->partialItemPath(draft_key));
+    }
+    m_draftJobs[draft_key] = job;
+    m_renderPool->render(job); // ahead of the final render, in the same batch
+}
+
+void MainWindow::draftFinished(RenderJob *job)
+{
+    const bool wanted = (m_draftJobs.value(job->key()) == job);
+    if (wanted) {
+        m_draftJobs.remove(job->key());
+    }
+    if (job->hasError()) {
+        return; // the final render tells what is wrong, if anything
+    }
 
     if (m_useCache && m_cache) {
-        m_cache->addItem(m_cachedImage, m_lastKey,
-                         [](const QString& path,
-                            const QString& key,
-                            int cost,
-                            const QDateTime& date_time,
-                            QObject* parent
-                            ) { return new FileCacheItem(path, key, cost, date_time, parent); });
+        if (job->outputPath().isEmpty()) {
+            m_cache->addItem(job->output(), job->key(), newFileCacheItem);
+        } else {
+            m_cache->addPartialItem(job->outputPath(), job->key(), job->output(), newFileCacheItem);
+        }
         updateCacheSizeInfo();
     }
-    statusBar()->showMessage(tr("Refreshed"), STATUSBAR_TIMEOUT);
+
+    const QString key = diagramKeyForDraft(job->key());
+    if (!wanted || !m_diagramKeys.contains(key) || m_diagramImages.contains(key)) {
+        return; // too late
+    }
+    m_draftImages[key] = job->output();
+    showDraftImages();
+}
+
+void MainWindow::showDraftImages()
+{
+    // until they are all there, the final images replace the drafts one by one
+    QList<QByteArray> images;
+    for (int i = 0; i < m_diagramKeys.size(); ++i) {
+        const QString& key = m_diagramKeys[i];
+        QByteArray image = m_diagramImages.value(key);
+        if (image.isEmpty()) {
+            image = m_draftImages.value(key);
+        }
+        if (image.isEmpty()) {
+            image = m_cachedImages.value(i); // what was there before
+        }
+        if (image.startsWith(TIMED_OUT_MARKER)) {
+            image.clear();
+        }
+        images << image;
+    }
+    m_imageWidget->load(images);
+    statusBar()->showMessage(tr("Showing a draft, refreshing %1 of %2 diagrams...")
+                             .arg(m_renderJobs.size() + m_rasterKeys.size()).arg(m_diagramKeys.size()));
+}
+
+void MainWindow::finishRefresh()
+{
+    if (!m_renderErrors.isEmpty()) {
+        QString errorMessage = m_renderErrors.join("\n");
+        m_renderErrors.clear();
+        QMessageBox message_box(QMessageBox::Critical, tr("Error"),
+                                errorMessage,
+                                QMessageBox::Ok, this);
+        if (!m_renderDiagnostics.isEmpty()) {
+            message_box.setDetailedText(m_renderDiagnostics.join("\n\n"));
+            m_renderDiagnostics.clear();
+        }
+        message_box.exec();
+        statusBar()->showMessage(errorMessage, STATUSBAR_TIMEOUT);
+        return;
+    }
+
+    if (showDiagramImages()) {
+        statusBar()->showMessage(tr("Refreshed"), STATUSBAR_TIMEOUT);
+    }
+    prepareOtherFormat();
+    updateDotMemoInfo();
+    // once the diagrams are shown, so that it doesn't slow them down
+    calibrateLayout();
+}
+
+void MainWindow::prepareOtherFormat()
+{
+    if (!m_prepareOtherFormat || !m_useCache || !m_cache || m_diagramSources.size() != m_diagramKeys.size()) {
+        return;
+    }
+
+    const ImageFormat other_format = (m_currentImageFormat == SvgFormat) ? PngFormat : SvgFormat;
+    for (int i = 0; i < m_diagramKeys.size(); ++i) {
+        const QByteArray image = m_diagramImages.value(m_diagramKeys[i]);
+        if (image.isEmpty() || image.startsWith(TIMED_OUT_MARKER)) {
+            continue;
+        }
+        const QString key = keyWithSuffix(m_diagramKeys[i], keySuffix(other_format));
+        if (m_cache->hasItem(key) || m_speculativeJobs.contains(key) || m_speculativeRasterKeys.contains(key)) {
+            continue;
+        }
+
+        if (other_format == PngFormat && m_derivePng) {
+            // no need for PlantUML, the image shown is the SVG one
+            m_speculativeRasterKeys << key;
+            m_rasterizer->rasterize(key, image);
+            continue;
+        }
+        // it only goes to the cache, whenever a worker has nothing better to do
+        RenderJob* job = new RenderJob(key, m_diagramSources[i], m_imageFormatNames[other_format]);
+        job->setPriority(RenderJob::BackgroundPriority);
+        job->setOutputPath(m_cache->partialItemPath(key));
+        m_speculativeJobs[key] = job;
+        m_renderPool->render(job);
+    }
 }
 
 void MainWindow::changeImageFormat()
@@ -386,18 +981,21 @@ void MainWindow::changeImageFormat()
 
 void MainWindow::onAutoRefreshActionToggled(bool state)
 {
+    m_refreshScheduler->setEnabled(state);
     if (state) {
         refresh();
-        m_autoRefreshTimer->start();
-    } else {
-        m_autoRefreshTimer->stop();
     }
     m_autoRefreshLabel->setEnabled(state);
 }
 
 void MainWindow::onEditorChanged()
 {
-    if (!refreshFromCache()) m_needsRefresh = true;
+    if (refreshFromCache()) {
+        m_refreshScheduler->cancel();
+    } else {
+        m_needsRefresh = true;
+        m_refreshScheduler->documentChanged();
+    }
 
     setWindowModified(true);
 
@@ -521,6 +1119,11 @@ void MainWindow::onCurrentAssistantChanged(int /*index*/)
     onAssistantItemSelectionChanged(); // make sure we don't show stale info
 }
 
+void MainWindow::onRenderPoolOccupancyChanged(int busy, int size)
+{
+    m_renderPoolLabel->setText(RENDER_POOL_FORMAT_STRING.arg(busy).arg(size));
+}
+
 void MainWindow::closeEvent(QCloseEvent *event)
 {
     if (maybeSave()) {
@@ -579,6 +1182,52 @@ void MainWindow::readSettings(bool reload)
     m_cacheMaxSize = settings.value(SETTINGS_CACHE_MAX_SIZE, SETTINGS_CACHE_MAX_SIZE_DEFAULT).toInt();
     m_cachePath = m_useCustomCache ? m_customCachePath : DEFAULT_CACHE_PATH;
 
+    m_renderBackend = settings.value(SETTINGS_RENDER_BACKEND, SETTINGS_RENDER_BACKEND_DEFAULT).toInt();
+    m_renderPool->setBackend(m_renderBackend == RenderPool::HttpBackend ? RenderPool::HttpBackend : RenderPool::PipeBackend);
+    m_renderServerPort = settings.value(SETTINGS_RENDER_SERVER_PORT, SETTINGS_RENDER_SERVER_PORT_DEFAULT).toInt();
+    m_renderPool->setServerPort(m_renderServerPort);
+    m_renderWorkers = settings.value(SETTINGS_RENDER_WORKERS, SETTINGS_RENDER_WORKERS_DEFAULT).toInt();
+    m_renderPool->setSize(m_renderWorkers);
+    m_keepRenderWorkersRunning = settings.value(SETTINGS_KEEP_RENDER_WORKERS_RUNNING, SETTINGS_KEEP_RENDER_WORKERS_RUNNING_DEFAULT).toBool();
+    m_renderPool->setKeepRunning(m_keepRenderWorkersRunning);
+    m_tuneJvm = settings.value(SETTINGS_TUNE_JVM, SETTINGS_TUNE_JVM_DEFAULT).toBool();
+    m_jvmProfile->setEnabled(m_tuneJvm);
+    m_jvmProfile->setPath(QDir(DEFAULT_CACHE_PATH).absoluteFilePath(JVM_PROFILE_DIR));
+    m_memoizeDot = settings.value(SETTINGS_MEMOIZE_DOT, SETTINGS_MEMOIZE_DOT_DEFAULT).toBool();
+    if (!m_dotMemo) {
+        // counted from the start of the session, apart from the other editors
+        // sharing the memo (a reused pid may have left counts behind)
+        m_dotMemo = new DotMemo(QDir(DEFAULT_CACHE_PATH).absoluteFilePath(DOT_MEMO_DIR),
+                                QString::number(QCoreApplication::applicationPid()));
+        m_dotMemo->resetCounts();
+        m_dotMemo->prune(DOT_MEMO_MAX_SIZE, QDateTime::currentDateTime().addSecs(-DOT_MEMO_PRUNE_AGE));
+    }
+    updateDotMemoInfo();
+    m_maxImageSize = settings.value(SETTINGS_MAX_IMAGE_SIZE, SETTINGS_MAX_IMAGE_SIZE_DEFAULT).toInt();
+    m_renderPool->setMaxOutputSize(m_maxImageSize);
+    m_renderTimeout = settings.value(SETTINGS_RENDER_TIMEOUT, SETTINGS_RENDER_TIMEOUT_DEFAULT).toInt();
+    m_renderPool->setTimeout(m_renderTimeout * 1000);
+    m_renderThreadDumps = settings.value(SETTINGS_RENDER_THREAD_DUMPS, SETTINGS_RENDER_THREAD_DUMPS_DEFAULT).toBool();
+    m_renderPool->setCaptureThreadDumps(m_renderThreadDumps);
+    m_derivePng = settings.value(SETTINGS_DERIVE_PNG, SETTINGS_DERIVE_PNG_DEFAULT).toBool();
+    m_pngDpi = settings.value(SETTINGS_PNG_DPI, SETTINGS_PNG_DPI_DEFAULT).toInt();
+    m_rasterizer->setDpi(m_pngDpi);
+    m_prepareOtherFormat = settings.value(SETTINGS_PREPARE_OTHER_FORMAT, SETTINGS_PREPARE_OTHER_FORMAT_DEFAULT).toBool();
+    m_draftPreview = settings.value(SETTINGS_DRAFT_PREVIEW, SETTINGS_DRAFT_PREVIEW_DEFAULT).toBool();
+    m_layoutEngine = settings.value(SETTINGS_LAYOUT_ENGINE, SETTINGS_LAYOUT_ENGINE_DEFAULT).toInt();
+    if (m_layoutEngine != AUTOMATIC_LAYOUT) {
+        m_layoutCalibrator->stop();
+    }
+    m_layoutChoices.clear();
+    foreach (const QString& choice, settings.value(SETTINGS_LAYOUT_CHOICES).toStringList()) {
+        const QString engine = choice.section('=', 1);
+        if (engine == GRAPHVIZ_LAYOUT_NAME || engine == SMETANA_LAYOUT_NAME) {
+            m_layoutChoices[choice.section('=', 0, 0).toUtf8()] = (engine == SMETANA_LAYOUT_NAME) ?
+                        LayoutCalibrator::SmetanaEngine : LayoutCalibrator::GraphvizEngine;
+        }
+    }
+    m_layoutChoicesSetup = settings.value(SETTINGS_LAYOUT_CHOICES_SETUP).toString();
+
     m_cache->setMaxCost(m_cacheMaxSize);
     m_cache->setPath(m_cachePath, [](const QString& path,
                                      const QString& key,
@@ -586,15 +1235,15 @@ void MainWindow::readSettings(bool reload)
                                      const QDateTime& date_time,
                                      QObject* parent
                                      ) { return new FileCacheItem(path, key, cost, date_time, parent); });
+    updateCacheGeneration();
 
     reloadAssistantXml(settings.value(SETTINGS_ASSISTANT_XML_PATH).toString());
 
     const bool autorefresh_enabled = settings.value(SETTINGS_AUTOREFRESH_ENABLED, false).toBool();
     m_autoRefreshAction->setChecked(autorefresh_enabled);
-    m_autoRefreshTimer->setInterval(settings.value(SETTINGS_AUTOREFRESH_TIMEOUT, SETTINGS_AUTOREFRESH_TIMEOUT_DEFAULT).toInt());
-    if (autorefresh_enabled) {
-        m_autoRefreshTimer->start();
-    }
+    m_refreshScheduler->setIdleDelay(settings.value(SETTINGS_AUTOREFRESH_IDLE_DELAY, SETTINGS_AUTOREFRESH_IDLE_DELAY_DEFAULT).toInt());
+    m_refreshScheduler->setMaxDelay(settings.value(SETTINGS_AUTOREFRESH_MAX_DELAY, SETTINGS_AUTOREFRESH_MAX_DELAY_DEFAULT).toInt());
+    m_refreshScheduler->setEnabled(autorefresh_enabled);
     m_autoRefreshLabel->setEnabled(autorefresh_enabled);
 
     m_autoSaveImageAction->setChecked(settings.value(SETTINGS_AUTOSAVE_IMAGE_ENABLED, SETTINGS_AUTOSAVE_IMAGE_ENABLED_DEFAULT).toBool());
@@ -665,9 +1314,32 @@ void MainWindow::writeSettings()
     settings.setValue(SETTINGS_CUSTOM_CACHE_PATH, m_customCachePath);
     settings.setValue(SETTINGS_CACHE_MAX_SIZE, m_cacheMaxSize);
 
+    settings.setValue(SETTINGS_RENDER_BACKEND, m_renderBackend);
+    settings.setValue(SETTINGS_RENDER_SERVER_PORT, m_renderServerPort);
+    settings.setValue(SETTINGS_RENDER_WORKERS, m_renderWorkers);
+    settings.setValue(SETTINGS_KEEP_RENDER_WORKERS_RUNNING, m_keepRenderWorkersRunning);
+    settings.setValue(SETTINGS_TUNE_JVM, m_tuneJvm);
+    settings.setValue(SETTINGS_MEMOIZE_DOT, m_memoizeDot);
+    settings.setValue(SETTINGS_MAX_IMAGE_SIZE, m_maxImageSize);
+    settings.setValue(SETTINGS_RENDER_TIMEOUT, m_renderTimeout);
+    settings.setValue(SETTINGS_RENDER_THREAD_DUMPS, m_renderThreadDumps);
+    settings.setValue(SETTINGS_DERIVE_PNG, m_derivePng);
+    settings.setValue(SETTINGS_PNG_DPI, m_pngDpi);
+    settings.setValue(SETTINGS_PREPARE_OTHER_FORMAT, m_prepareOtherFormat);
+    settings.setValue(SETTINGS_DRAFT_PREVIEW, m_draftPreview);
+    settings.setValue(SETTINGS_LAYOUT_ENGINE, m_layoutEngine);
+    QStringList layout_choices;
+    foreach (const QByteArray& kind, m_layoutChoices.keys()) {
+        layout_choices << QString("%1=%2").arg(QString(kind))
+                          .arg(m_layoutChoices[kind] == LayoutCalibrator::SmetanaEngine ? SMETANA_LAYOUT_NAME : GRAPHVIZ_LAYOUT_NAME);
+    }
+    settings.setValue(SETTINGS_LAYOUT_CHOICES, layout_choices);
+    settings.setValue(SETTINGS_LAYOUT_CHOICES_SETUP, m_layoutChoicesSetup);
+
     settings.setValue(SETTINGS_ASSISTANT_XML_PATH, m_assistantXmlPath);
 
-    settings.setValue(SETTINGS_AUTOREFRESH_TIMEOUT, m_autoRefreshTimer->interval());
+    settings.setValue(SETTINGS_AUTOREFRESH_IDLE_DELAY, m_refreshScheduler->idleDelay());
+    settings.setValue(SETTINGS_AUTOREFRESH_MAX_DELAY, m_refreshScheduler->maxDelay());
 
     settings.setValue(SETTINGS_GEOMETRY, saveGeometry());
     settings.setValue(SETTINGS_WINDOW_STATE, saveState());
@@ -709,6 +1381,7 @@ void MainWindow::openDocument(const QString &name)
     if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
         return;
     }
+    m_dependencyHashes.clear(); // the includes are resolved from elsewhere
     m_editor->setPlainText(QString::fromUtf8(file.readAll()));
     setWindowModified(false);
     m_documentPath = tmp_name;
@@ -748,6 +1421,9 @@ bool MainWindow::saveDocument(const QString &name)
     }
     file.write(m_editor->toPlainText().toUtf8());
     file.close();
+    if (m_documentPath != file_path) {
+        m_dependencyHashes.clear(); // the includes are resolved from elsewhere
+    }
     m_documentPath = file_path;
     setWindowTitle(TITLE_FORMAT_STRING
                    .arg(QFileInfo(file_path).fileName())
@@ -764,21 +1440,56 @@ bool MainWindow::saveDocument(const QString &name)
                 .arg(m_imageFormatNames[m_currentImageFormat])
                 ;
         qDebug() << "saving image in:   " << image_path;
-        QFile image(image_path);
-        if (!image.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        if (!saveImages(image_path)) {
             return false;
         }
-        image.write(m_cachedImage);
-        image.close();
     }
     m_editor->document()->setModified(false);
     setWindowModified(false);
     return true;
 }
 
+bool MainWindow::saveImages(const QString &path)
+{
+    // like PlantUML does, the diagrams after the first one are numbered
+    QFileInfo info(path);
+    // the PNG images are made from the SVG preview, the SVG ones of the PNG
+    // preview may have been rendered in the background
+    const bool to_png = (m_currentImageFormat == SvgFormat &&
+                         info.suffix().compare(m_imageFormatNames[PngFormat], Qt::CaseInsensitive) == 0);
+    const bool to_svg = (m_currentImageFormat == PngFormat &&
+                         info.suffix().compare(m_imageFormatNames[SvgFormat], Qt::CaseInsensitive) == 0);
+    for (int i = 0; i < m_cachedImages.size(); ++i) {
+        QString image_path = path;
+        if (i > 0) {
+            image_path = QString("%1/%2_%3.%4")
+                    .arg(info.absolutePath())
+                    .arg(info.completeBaseName())
+                    .arg(i, 3, 10, QChar('0'))
+                    .arg(info.suffix())
+                    ;
+        }
+        QFile file(image_path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        QByteArray image = m_cachedImages[i];
+        if (to_png) {
+            image = derivedPng(m_diagramKeys.value(i), image);
+        } else if (to_svg) {
+            const QByteArray svg = imageFromCache(keyWithSuffix(m_diagramKeys.value(i), keySuffix(SvgFormat)));
+            if (!svg.isEmpty() && !svg.startsWith(TIMED_OUT_MARKER)) {
+                image = svg;
+            }
+        }
+        file.write(image);
+    }
+    return true;
+}
+
 void MainWindow::exportImage(const QString &name)
 {
-    if (m_cachedImage.isEmpty()) {
+    if (m_cachedImages.isEmpty()) {
         qDebug() << "no image to export. aborting...";
         return;
     }
@@ -797,11 +1508,9 @@ void MainWindow::exportImage(const QString &name)
 
     qDebug() << "exporting image in:" << tmp_name;
 
-    QFile file(tmp_name);
-    if (!file.open(QIODevice::WriteOnly)) {
+    if (!saveImages(tmp_name)) {
         return;
     }
-    file.write(m_cachedImage);
     m_exportImageAction->setText(EXPORT_TO_MENU_FORMAT_STRING.arg(tmp_name));
     m_exportPath = tmp_name;
     QString short_tmp_name = QFileInfo(tmp_name).fileName();
@@ -1025,6 +1734,15 @@ void MainWindow::createStatusBar()
     m_cacheSizeLabel = new QLabel(this);
     m_cacheSizeLabel->setMinimumWidth(font_metrics.width(QString(CACHE_SIZE_FORMAT_STRING.arg("#.## Mb"))));
 
+    m_renderPoolLabel = new QLabel(this);
+    m_renderPoolLabel->setMinimumWidth(font_metrics.width(QString(RENDER_POOL_FORMAT_STRING.arg("##").arg("##"))));
+    connect(m_renderPool, SIGNAL(occupancyChanged(int,int)), this, SLOT(onRenderPoolOccupancyChanged(int,int)));
+    onRenderPoolOccupancyChanged(m_renderPool->busyCount(), m_renderPool->size());
+
+    m_dotMemoLabel = new QLabel(this);
+    m_dotMemoLabel->setToolTip(tr("The Graphviz layouts served from the memo, and those dot had to compute"));
+    m_dotMemoLabel->setVisible(false);
+
     m_autoRefreshLabel = new QLabel(this);
     m_autoRefreshLabel->setText(AUTOREFRESH_STATUS_LABEL);
 
@@ -1033,11 +1751,15 @@ void MainWindow::createStatusBar()
     m_exportPathLabel->setFrameStyle(label_fram_style);
     m_currentImageFormatLabel->setFrameStyle(label_fram_style);
     m_cacheSizeLabel->setFrameStyle(label_fram_style);
+    m_renderPoolLabel->setFrameStyle(label_fram_style);
+    m_dotMemoLabel->setFrameStyle(label_fram_style);
     m_autoRefreshLabel->setFrameStyle(label_fram_style);
 #endif
 
     statusBar()->addPermanentWidget(m_exportPathLabel);
     statusBar()->addPermanentWidget(m_cacheSizeLabel);
+    statusBar()->addPermanentWidget(m_renderPoolLabel);
+    statusBar()->addPermanentWidget(m_dotMemoLabel);
     statusBar()->addPermanentWidget(m_autoRefreshLabel);
     statusBar()->addPermanentWidget(m_currentImageFormatLabel);
 
@@ -1048,6 +1770,7 @@ void MainWindow::createDockWindows()
 {
     QDockWidget *dock = new QDockWidget(tr("Text Editor"), this);
     m_editor = new TextEdit(dock);
+    m_documentDigest = new DocumentDigest(m_editor->document(), this);
     connect(m_editor->document(), SIGNAL(contentsChanged()), this, SLOT(onEditorChanged()));
     dock->setWidget(m_editor);
     dock->setObjectName("text_editor");
@@ -1118,6 +1841,27 @@ void MainWindow::checkPaths()
             QFileInfo(m_plantUmlPath).exists();
 }
 
+RenderSettings MainWindow::renderSettings() const
+{
+    RenderSettings settings;
+    settings.javaPath = m_javaPath;
+    settings.plantUmlPath = m_plantUmlPath;
+    if (m_useCustomGraphiz) {
+        settings.graphizPath = m_graphizPath;
+    }
+    if (m_memoizeDot) {
+        // PlantUML runs the editor as its dot, see DotMemo
+        settings.environment = DotMemo::shimEnvironment(m_useCustomGraphiz ? m_graphizPath : DOT_PROGRAM,
+                                                        m_dotMemo->path(), m_dotMemo->session());
+        settings.graphizPath = QCoreApplication::applicationFilePath();
+    }
+    settings.workingDirectory = QFileInfo(m_documentPath).absolutePath();
+    // the -pipe processes exit after each batch unless they are kept running
+    const bool short_lived = m_renderPool->backend() == RenderPool::PipeBackend && !m_keepRenderWorkersRunning;
+    settings.javaOptions = m_jvmProfile->javaOptions(m_javaPath, m_plantUmlPath, short_lived);
+    return settings;
+}
+
 void MainWindow::reloadAssistantXml(const QString &path)
 {
     if (m_assistantXmlPath != path) {
@@ -1127,6 +1871,7 @@ void MainWindow::reloadAssistantXml(const QString &path)
             widget->deleteLater();
         }
         m_assistantWidgets.clear();
+        m_calibrationSamples.clear();
 
         if (m_assistantXmlPath.isEmpty()) {
             qDebug() << "No assistant defined.";
@@ -1147,6 +1892,7 @@ void MainWindow::reloadAssistantXml(const QString &path)
                                                 assistantItem->name(), view);
                     listWidgetItem->setData(ASSISTANT_ITEM_DATA_ROLE, assistantItem->data());
                     listWidgetItem->setData(ASSISTANT_ITEM_NOTES_ROLE, assistantItem->notes());
+                    m_calibrationSamples << "@startuml\n" + assistantItem->data().toUtf8() + "\n@enduml\n";
                 }
                 m_assistantToolBox->addItem(view, assistant->name());
                 connect(view, SIGNAL(itemDoubleClicked(QListWidgetItem*)),
@@ -2,14 +2,16 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QHash>
 #include <QMap>
+#include <QSet>
+#include <QStringList>
+#include "documentdigest.h"
 
 class QAction;
 class QMenu;
 class QTextEdit;
-class QProcess;
 class PreviewWidget;
-class QTimer;
 class QLabel;
 class QSignalMapper;
 class QToolBox;
@@ -20,6 +22,16 @@ class RecentDocuments;
 class QSignalMapper;
 class QScrollArea;
 class TextEdit;
+class RenderPool;
+class RenderJob;
+struct RenderSettings;
+class RefreshScheduler;
+class JvmProfile;
+class SvgRasterizer;
+class LayoutCalibrator;
+class DotMemo;
+class IncludeResolver;
+class DocumentHash;
 
 class MainWindow : public QMainWindow
 {
@@ -37,7 +49,10 @@ public slots:
 private slots:
     void about();
     void refresh(bool forced = false);
-    void refreshFinished();
+    void refreshFinished(RenderJob* job);
+    void onSvgRasterized(const QString& key, const QByteArray& png);
+    void onLayoutCalibrated();
+    void updateCacheSizeInfo();
     void changeImageFormat();
     void undo();
     void redo();
@@ -61,6 +76,7 @@ private slots:
     void onPrevAssistant();
     void onAssistantItemSelectionChanged();
     void onCurrentAssistantChanged(int index);
+    void onRenderPoolOccupancyChanged(int busy, int size);
 
 private:
     enum ImageFormat { SvgFormat, PngFormat };
@@ -71,8 +87,18 @@ private:
     void readSettings(bool reload = false);
     void writeSettings();
     bool saveDocument(const QString& name);
+    bool saveImages(const QString& path);
     void exportImage(const QString& name);
-    QString makeKeyForDocument(QByteArray current_document);
+    // empty for a diagram with includes not resolved since it last changed
+    QString makeKeyForDiagram(const DocumentLines::Diagram& diagram);
+    QStringList makeKeysForDiagrams(const QList<DocumentLines::Diagram>& diagrams);
+    QString keySuffix(ImageFormat format) const;
+    // PNG images may be made out of the SVG ones: their diagrams are then
+    // rendered under the SVG key
+    QString renderKeyFor(const QString& key) const;
+    QString diagramKeyFor(const QString& render_key) const;
+    QString draftKeyFor(const QString& key) const;
+    QString diagramKeyForDraft(const QString& draft_key) const; //< empty if not for the current format
 
     void createActions();
     void createMenus();
@@ -83,22 +109,45 @@ private:
     void addZoomActions(QWidget* widget);
 
     void checkPaths();
+    RenderSettings renderSettings() const;
     void reloadAssistantXml(const QString& path);
     void insertAssistantCode(const QString& code);
 
+    QByteArray imageFromCache(const QString& key) const;
+    bool findDiagramImages(const QStringList& keys, QMap<QString, QByteArray>& images) const;
+    void setPreviewMode();
+    // false if some of them timed out, which the status bar then tells
+    bool showDiagramImages();
+    void showCachedDiagrams(const QStringList& keys, const QMap<QString, QByteArray>& images);
     bool refreshFromCache();
-    void updateCacheSizeInfo();
+    bool usesSmetana(const QByteArray& kind) const;
+    // the text of the diagrams of the document, laid out by the chosen engines
+    QList<QByteArray> diagramsToRender(const QList<DocumentLines::Diagram>& diagrams) const;
+    void calibrateLayout();
+    void deriveDiagramImage(const QString& key, const QByteArray& svg);
+    QByteArray derivedPng(const QString& key, const QByteArray& svg);
+    void startDraft(const QString& key, const QByteArray& diagram);
+    void draftFinished(RenderJob* job);
+    void showDraftImages();
+    void finishRefresh();
+    void prepareOtherFormat();
+    void supersedeRenderJobs(const QStringList& keep_keys = QStringList());
+    void updateCacheGeneration();
+    // the files included by these diagrams are looked at again
+    void updateDependencyHashes(const QList<DocumentLines::Diagram>& diagrams);
+    void updateDotMemoInfo();
     void focusAssistant();
 
     QLabel *m_currentImageFormatLabel;
     QLabel *m_autoRefreshLabel;
     QLabel *m_exportPathLabel;
     QLabel *m_cacheSizeLabel;
+    QLabel *m_renderPoolLabel;
+    QLabel *m_dotMemoLabel;
 
     QString m_documentPath;
     QString m_exportPath;
-    QString m_lastKey;
-    QByteArray m_cachedImage;
+    QList<QByteArray> m_cachedImages; // one per diagram of the document
 
     QString m_assistantXmlPath;
     QList<QListWidget*> m_assistantWidgets;
@@ -110,6 +159,13 @@ private:
     bool m_useCustomCache;
     bool m_refreshOnSave;
     int m_cacheMaxSize;
+    int m_renderBackend;
+    int m_renderServerPort;
+    int m_renderWorkers;
+    bool m_keepRenderWorkersRunning;
+    int m_maxImageSize;
+    int m_renderTimeout;
+    bool m_renderThreadDumps;
 
     QString m_javaPath;
     QString m_plantUmlPath;
@@ -123,10 +179,48 @@ private:
 
     bool m_hasValidPaths;
 
-    QProcess *m_process;
+    RenderPool *m_renderPool;
+    // the diagrams of the document being shown, and their images
+    QStringList m_diagramKeys;
+    QList<QByteArray> m_diagramSources; // of the last diagrams rendered
+    QMap<QString, QByteArray> m_diagramImages;
+    // the cached items found or added as timed out, which a new render replaces
+    mutable QSet<QString> m_timedOutKeys;
+    QMap<QString, RenderJob*> m_renderJobs; // the diagrams still being rendered
+    QSet<QString> m_rasterKeys; // the PNG images still being made from SVG ones
+    // the images in the other format, rendered for the cache only
+    QMap<QString, RenderJob*> m_speculativeJobs;
+    QSet<QString> m_speculativeRasterKeys;
+    // the quick drafts shown while the diagrams are rendered, by diagram key
+    QMap<QString, RenderJob*> m_draftJobs;
+    QMap<QString, QByteArray> m_draftImages;
+    QStringList m_renderErrors;
+    QStringList m_renderDiagnostics; // of the diagrams which timed out
     QMap<ImageFormat, QString> m_imageFormatNames;
     ImageFormat m_currentImageFormat;
-    QTimer *m_autoRefreshTimer;
+    RefreshScheduler *m_refreshScheduler;
+    JvmProfile *m_jvmProfile;
+    SvgRasterizer *m_rasterizer;
+    bool m_derivePng;
+    int m_pngDpi;
+    bool m_prepareOtherFormat;
+    bool m_draftPreview;
+    bool m_memoizeDot;
+    DotMemo *m_dotMemo;
+    IncludeResolver *m_includeResolver;
+    DocumentHash *m_documentHash;
+    DocumentDigest *m_documentDigest;
+    // of the diagrams with includes, by digest, as of the last refresh
+    QHash<QByteArray, QByteArray> m_dependencyHashes;
+    int m_layoutEngine;
+    LayoutCalibrator *m_layoutCalibrator;
+    QList<QByteArray> m_calibrationSamples; // the diagrams of the assistant
+    // the LayoutCalibrator::Engine of each kind of diagram, and the setup it
+    // was measured with
+    QMap<QByteArray, int> m_layoutChoices;
+    QString m_layoutChoicesSetup;
+    QString m_calibratingSetup;
+    bool m_tuneJvm;
     bool m_needsRefresh;
 
     TextEdit *m_editor;
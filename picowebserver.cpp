@@ -0,0 +1,215 @@
+#include "picowebserver.h"
+#include "renderprocess.h"
+#include <QStringList>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QNetworkAccessManager>
+#include <QTimer>
+#include <QDebug>
+
+//------------------------------------------------------------------------------
+
+namespace {
+const QString HOST = "127.0.0.1";
+// how often a starting server is checked, and for how long
+const int PROBE_INTERVAL = 100; // in miliseconds
+const int STARTUP_TIMEOUT = 30000; // in miliseconds
+
+int findFreePort()
+{
+    QTcpServer server;
+    if (!server.listen(QHostAddress::LocalHost, 0)) {
+        return 0;
+    }
+    int port = server.serverPort();
+    server.close();
+    return port;
+}
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+PicowebServer::PicowebServer(QObject *parent)
+    : QObject(parent)
+    , m_requestedPort(0)
+    , m_port(0)
+    , m_state(NotRunning)
+    , m_process(0)
+{
+    m_probe = new QTcpSocket(this);
+    connect(m_probe, SIGNAL(connected()), this, SLOT(onProbeConnected()));
+    connect(m_probe, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(onProbeError()));
+
+    m_network = new QNetworkAccessManager(this);
+}
+
+PicowebServer::~PicowebServer()
+{
+    stop();
+}
+
+void PicowebServer::setSettings(const RenderSettings &settings)
+{
+    if (m_settings != settings) {
+        m_settings = settings;
+        if (m_state != NotRunning) {
+            stop();
+            start();
+        }
+    }
+}
+
+void PicowebServer::setRequestedPort(int port)
+{
+    if (m_requestedPort != port) {
+        m_requestedPort = port;
+        if (m_state != NotRunning) {
+            stop();
+            start();
+        }
+    }
+}
+
+QUrl PicowebServer::url(const QString &path) const
+{
+    QUrl url;
+    url.setScheme("http");
+    url.setHost(HOST);
+    url.setPort(m_port);
+    url.setPath(path);
+    return url;
+}
+
+void PicowebServer::start()
+{
+    if (m_state != NotRunning) {
+        return;
+    }
+
+    m_state = Starting;
+    if (m_requestedPort > 0) {
+        // look for a server already listening there before starting ours
+        m_port = m_requestedPort;
+        probe();
+    } else {
+        m_port = findFreePort();
+        if (m_port == 0) {
+            fail(tr("No free port for the PlantUML server"));
+            return;
+        }
+        startProcess();
+    }
+}
+
+void PicowebServer::stop()
+{
+    if (m_process) {
+        m_process->disconnect(this);
+        m_process->killTree();
+        m_process->deleteLater();
+        m_process = 0;
+    }
+    m_probe->abort();
+    m_state = NotRunning;
+}
+
+void PicowebServer::connectionLost()
+{
+    // our own server is watched through its process, but nothing tells when
+    // a shared one goes away
+    if (isShared()) {
+        qDebug() << "lost the shared PlantUML server on port" << m_port;
+        m_state = NotRunning;
+    }
+}
+
+void PicowebServer::probe()
+{
+    if (m_state != Starting) {
+        return; // stopped in the meantime
+    }
+    m_probe->abort();
+    m_probe->connectToHost(HOST, m_port);
+}
+
+void PicowebServer::onProbeConnected()
+{
+    m_probe->abort();
+    if (m_state != Starting) {
+        return;
+    }
+
+    qDebug() << (m_process ? "PlantUML server listening on port" : "sharing the PlantUML server on port") << m_port;
+    m_state = Listening;
+    emit listening();
+}
+
+void PicowebServer::onProbeError()
+{
+    if (m_state != Starting) {
+        return;
+    }
+
+    if (!m_process) {
+        // nobody listens on the requested port yet
+        startProcess();
+    } else if (m_startTime.elapsed() > STARTUP_TIMEOUT) {
+        fail(tr("The PlantUML server didn't listen on port %1 after %2 seconds").arg(m_port).arg(STARTUP_TIMEOUT / 1000));
+    } else {
+        QTimer::singleShot(PROBE_INTERVAL, this, SLOT(probe()));
+    }
+}
+
+void PicowebServer::onProcessFinished(int exit_code, QProcess::ExitStatus exit_status)
+{
+    QString reason = (exit_status == QProcess::CrashExit) ?
+                tr("The PlantUML server crashed") :
+                tr("The PlantUML server exited with code %1").arg(exit_code);
+    if (m_state == Starting) {
+        fail(reason);
+    } else {
+        // started again with the next job
+        qDebug() << reason;
+        stop();
+    }
+}
+
+void PicowebServer::onProcessError(QProcess::ProcessError error)
+{
+    if (error == QProcess::FailedToStart) {
+        fail(tr("Failed to start %1: %2").arg(m_settings.javaPath).arg(m_process->errorString()));
+    }
+}
+
+void PicowebServer::startProcess()
+{
+    QStringList arguments;
+    arguments << m_settings.javaOptions
+              << "-jar" << m_settings.plantUmlPath;
+    if (!m_settings.graphizPath.isEmpty()) {
+        arguments << "-graphizdot" << m_settings.graphizPath;
+    }
+    arguments << QString("-picoweb:%1:%2").arg(m_port).arg(HOST);
+
+    m_process = new RenderProcess(this);
+    m_process->setWorkingDirectory(m_settings.workingDirectory);
+    m_process->addEnvironment(m_settings.environment);
+
+    connect(m_process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(onProcessFinished(int,QProcess::ExitStatus)));
+    connect(m_process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(onProcessError(QProcess::ProcessError)));
+
+    qDebug() << "starting PlantUML server on port" << m_port;
+    m_startTime.start();
+    m_process->start(m_settings.javaPath, arguments);
+    QTimer::singleShot(PROBE_INTERVAL, this, SLOT(probe()));
+}
+
+void PicowebServer::fail(const QString &reason)
+{
+    qDebug() << reason;
+    stop();
+    emit failed(reason);
+}
+
+//------------------------------------------------------------------------------
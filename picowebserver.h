@@ -0,0 +1,79 @@
+#ifndef PICOWEBSERVER_H
+#define PICOWEBSERVER_H
+
+#include <QObject>
+#include <QString>
+#include <QUrl>
+#include <QProcess>
+#include <QElapsedTimer>
+#include "renderworker.h"
+
+class QTcpSocket;
+class RenderProcess;
+class QNetworkAccessManager;
+
+//------------------------------------------------------------------------------
+
+// Supervises a PlantUML HTTP server (-picoweb) listening on localhost. It is
+// started on demand and is ready once it accepts connections. When a fixed
+// port is set and some server already listens on it, that server is used
+// instead of starting another one, so several local tools can share one JVM.
+// A server that exits is started again by the next start().
+class PicowebServer : public QObject
+{
+    Q_OBJECT
+public:
+    enum State { NotRunning, Starting, Listening };
+
+    explicit PicowebServer(QObject* parent = 0);
+    virtual ~PicowebServer();
+
+    const RenderSettings& settings() const { return m_settings; }
+    void setSettings(const RenderSettings& settings); //< restarts the server if needed
+
+    int requestedPort() const { return m_requestedPort; }
+    void setRequestedPort(int port); //< 0 means any free port
+    int port() const { return m_port; } //< the port in use once listening
+
+    State state() const { return m_state; }
+    bool isListening() const { return m_state == Listening; }
+    bool isShared() const { return m_state == Listening && !m_process; }
+
+    QUrl url(const QString& path) const;
+    // shared by the HTTP workers, so they all use the same connections
+    QNetworkAccessManager* networkAccessManager() const { return m_network; }
+
+public slots:
+    void start();
+    void stop();
+    // called when a request couldn't reach the server
+    void connectionLost();
+
+signals:
+    void listening();
+    void failed(const QString& reason);
+
+private slots:
+    void probe();
+    void onProbeConnected();
+    void onProbeError();
+    void onProcessFinished(int exit_code, QProcess::ExitStatus exit_status);
+    void onProcessError(QProcess::ProcessError error);
+
+private:
+    void startProcess();
+    void fail(const QString& reason);
+
+    RenderSettings m_settings;
+    int m_requestedPort;
+    int m_port;
+    State m_state;
+    RenderProcess* m_process;
+    QTcpSocket* m_probe;
+    QElapsedTimer m_startTime;
+    QNetworkAccessManager* m_network;
+};
+
+//------------------------------------------------------------------------------
+
+#endif // PICOWEBSERVER_H
@@ -1,4 +1,4 @@
-QT += core gui svg
+QT += core gui svg network
 
 QMAKE_CXXFLAGS += -std=c++11
 
@@ -19,7 +19,21 @@ SOURCES += \
     assistantxmlreader.cpp \
     filecache.cpp \
     utils.cpp \
-    recentdocuments.cpp
+    recentdocuments.cpp \
+    diagramsource.cpp \
+    renderworker.cpp \
+    renderpool.cpp \
+    renderprocess.cpp \
+    refreshscheduler.cpp \
+    picowebserver.cpp \
+    httprenderworker.cpp \
+    jvmprofile.cpp \
+    svgrasterizer.cpp \
+    layoutcalibrator.cpp \
+    dotmemo.cpp \
+    includeresolver.cpp \
+    documenthash.cpp \
+    documentdigest.cpp
 
 HEADERS += \
     textedit.h \
@@ -30,7 +44,21 @@ HEADERS += \
     filecache.h \
     settingsconstants.h \
     utils.h \
-    recentdocuments.h
+    recentdocuments.h \
+    diagramsource.h \
+    renderworker.h \
+    renderpool.h \
+    renderprocess.h \
+    refreshscheduler.h \
+    picowebserver.h \
+    httprenderworker.h \
+    jvmprofile.h \
+    svgrasterizer.h \
+    layoutcalibrator.h \
+    dotmemo.h \
+    includeresolver.h \
+    documenthash.h \
+    documentdigest.h
 
 FORMS += \
     preferencesdialog.ui
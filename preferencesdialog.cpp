@@ -60,7 +60,8 @@ void PreferencesDialog::readSettings()
         m_ui->defaultGraphizRadio->setChecked(true);
     m_ui->customGraphizEdit->setText(settings.value(SETTINGS_CUSTOM_GRAPHIZ_PATH).toString());
 
-    m_ui->autoRefreshSpin->setValue(settings.value(SETTINGS_AUTOREFRESH_TIMEOUT).toInt() / TIMEOUT_SCALE);
+    m_ui->autoRefreshIdleSpin->setValue(settings.value(SETTINGS_AUTOREFRESH_IDLE_DELAY, SETTINGS_AUTOREFRESH_IDLE_DELAY_DEFAULT).toInt());
+    m_ui->autoRefreshMaxSpin->setValue(settings.value(SETTINGS_AUTOREFRESH_MAX_DELAY, SETTINGS_AUTOREFRESH_MAX_DELAY_DEFAULT).toInt());
     m_ui->assistantXmlEdit->setText(settings.value(SETTINGS_ASSISTANT_XML_PATH).toString());
 
     m_ui->cacheGroupBox->setChecked(settings.value(SETTINGS_USE_CACHE, SETTINGS_USE_CACHE_DEFAULT).toBool());
@@ -71,6 +72,22 @@ void PreferencesDialog::readSettings()
     m_ui->customCacheEdit->setText(settings.value(SETTINGS_CUSTOM_CACHE_PATH).toString());
     m_ui->cacheMaxSize->setValue(settings.value(SETTINGS_CACHE_MAX_SIZE, SETTINGS_CACHE_MAX_SIZE_DEFAULT).toInt() / CACHE_SCALE);
 
+    m_ui->renderBackendCombo->setCurrentIndex(settings.value(SETTINGS_RENDER_BACKEND, SETTINGS_RENDER_BACKEND_DEFAULT).toInt());
+    m_ui->renderServerPortSpin->setValue(settings.value(SETTINGS_RENDER_SERVER_PORT, SETTINGS_RENDER_SERVER_PORT_DEFAULT).toInt());
+    m_ui->renderWorkersSpin->setValue(settings.value(SETTINGS_RENDER_WORKERS, SETTINGS_RENDER_WORKERS_DEFAULT).toInt());
+    m_ui->keepRenderWorkersRunningCheckBox->setChecked(settings.value(SETTINGS_KEEP_RENDER_WORKERS_RUNNING, SETTINGS_KEEP_RENDER_WORKERS_RUNNING_DEFAULT).toBool());
+    m_ui->tuneJvmCheckBox->setChecked(settings.value(SETTINGS_TUNE_JVM, SETTINGS_TUNE_JVM_DEFAULT).toBool());
+    m_ui->maxImageSizeSpin->setValue(settings.value(SETTINGS_MAX_IMAGE_SIZE, SETTINGS_MAX_IMAGE_SIZE_DEFAULT).toInt() / CACHE_SCALE);
+    m_ui->renderTimeoutSpin->setValue(settings.value(SETTINGS_RENDER_TIMEOUT, SETTINGS_RENDER_TIMEOUT_DEFAULT).toInt());
+    m_ui->threadDumpsCheckBox->setChecked(settings.value(SETTINGS_RENDER_THREAD_DUMPS, SETTINGS_RENDER_THREAD_DUMPS_DEFAULT).toBool());
+    m_ui->derivePngCheckBox->setChecked(settings.value(SETTINGS_DERIVE_PNG, SETTINGS_DERIVE_PNG_DEFAULT).toBool());
+    m_ui->pngDpiSpin->setValue(settings.value(SETTINGS_PNG_DPI, SETTINGS_PNG_DPI_DEFAULT).toInt());
+    m_ui->pngDpiSpin->setEnabled(m_ui->derivePngCheckBox->isChecked());
+    m_ui->prepareOtherFormatCheckBox->setChecked(settings.value(SETTINGS_PREPARE_OTHER_FORMAT, SETTINGS_PREPARE_OTHER_FORMAT_DEFAULT).toBool());
+    m_ui->draftPreviewCheckBox->setChecked(settings.value(SETTINGS_DRAFT_PREVIEW, SETTINGS_DRAFT_PREVIEW_DEFAULT).toBool());
+    m_ui->memoizeDotCheckBox->setChecked(settings.value(SETTINGS_MEMOIZE_DOT, SETTINGS_MEMOIZE_DOT_DEFAULT).toBool());
+    m_ui->layoutEngineCombo->setCurrentIndex(settings.value(SETTINGS_LAYOUT_ENGINE, SETTINGS_LAYOUT_ENGINE_DEFAULT).toInt());
+
     settings.endGroup();
 
     settings.beginGroup(SETTINGS_EDITOR_SECTION);
@@ -113,7 +130,8 @@ void PreferencesDialog::writeSettings()
     settings.setValue(SETTINGS_USE_CUSTOM_GRAPHIZ, m_ui->customGraphizRadio->isChecked());
     settings.setValue(SETTINGS_CUSTOM_GRAPHIZ_PATH, m_ui->customGraphizEdit->text());
 
-    settings.setValue(SETTINGS_AUTOREFRESH_TIMEOUT, m_ui->autoRefreshSpin->value() * TIMEOUT_SCALE);
+    settings.setValue(SETTINGS_AUTOREFRESH_IDLE_DELAY, m_ui->autoRefreshIdleSpin->value());
+    settings.setValue(SETTINGS_AUTOREFRESH_MAX_DELAY, m_ui->autoRefreshMaxSpin->value());
     settings.setValue(SETTINGS_ASSISTANT_XML_PATH, m_ui->assistantXmlEdit->text());
 
     settings.setValue(SETTINGS_USE_CACHE, m_ui->cacheGroupBox->isChecked());
@@ -121,6 +139,21 @@ void PreferencesDialog::writeSettings()
     settings.setValue(SETTINGS_CUSTOM_CACHE_PATH, m_ui->customCacheEdit->text());
     settings.setValue(SETTINGS_CACHE_MAX_SIZE, m_ui->cacheMaxSize->value() * CACHE_SCALE);
 
+    settings.setValue(SETTINGS_RENDER_BACKEND, m_ui->renderBackendCombo->currentIndex());
+    settings.setValue(SETTINGS_RENDER_SERVER_PORT, m_ui->renderServerPortSpin->value());
+    settings.setValue(SETTINGS_RENDER_WORKERS, m_ui->renderWorkersSpin->value());
+    settings.setValue(SETTINGS_KEEP_RENDER_WORKERS_RUNNING, m_ui->keepRenderWorkersRunningCheckBox->isChecked());
+    settings.setValue(SETTINGS_TUNE_JVM, m_ui->tuneJvmCheckBox->isChecked());
+    settings.setValue(SETTINGS_MAX_IMAGE_SIZE, m_ui->maxImageSizeSpin->value() * CACHE_SCALE);
+    settings.setValue(SETTINGS_RENDER_TIMEOUT, m_ui->renderTimeoutSpin->value());
+    settings.setValue(SETTINGS_RENDER_THREAD_DUMPS, m_ui->threadDumpsCheckBox->isChecked());
+    settings.setValue(SETTINGS_DERIVE_PNG, m_ui->derivePngCheckBox->isChecked());
+    settings.setValue(SETTINGS_PNG_DPI, m_ui->pngDpiSpin->value());
+    settings.setValue(SETTINGS_PREPARE_OTHER_FORMAT, m_ui->prepareOtherFormatCheckBox->isChecked());
+    settings.setValue(SETTINGS_DRAFT_PREVIEW, m_ui->draftPreviewCheckBox->isChecked());
+    settings.setValue(SETTINGS_MEMOIZE_DOT, m_ui->memoizeDotCheckBox->isChecked());
+    settings.setValue(SETTINGS_LAYOUT_ENGINE, m_ui->layoutEngineCombo->currentIndex());
+
     settings.endGroup();
 
     settings.beginGroup(SETTINGS_EDITOR_SECTION);
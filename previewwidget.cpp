@@ -8,27 +8,82 @@ namespace {
     const int ZOOM_SMALL_INCREMENT = 25; // used when m_zoomScale < ZOOM_ORIGINAL_SCALE
     const int MAX_ZOOM_SCALE = 900;
     const int MIN_ZOOM_SCALE = 25;
+    const int BLOCK_SPACING = 20; // between the diagrams of a document, not zoomed
 }
 PreviewWidget::PreviewWidget(QWidget *parent)
     : QWidget(parent)
     , m_mode(NoMode)
+    , m_loadedMode(NoMode)
     , m_zoomScale(ZOOM_ORIGINAL_SCALE)
 {
-    m_svgRenderer = new QSvgRenderer(this);
 }
 
 void PreviewWidget::load(const QByteArray &data)
 {
+    load(QList<QByteArray>() << data);
+}
+
+void PreviewWidget::load(const QList<QByteArray> &images)
+{
+    if (m_mode != m_loadedMode) {
+        m_data.clear();
+        m_images.clear();
+        qDeleteAll(m_svgRenderers);
+        m_svgRenderers.clear();
+        m_loadedMode = m_mode;
+    }
+
     if (m_mode == PngMode) {
-        m_image.loadFromData(data);
-        setMinimumSize(m_image.rect().size());
+        for (int i = 0; i < images.size(); ++i) {
+            if (i < m_data.size() && m_data[i] == images[i]) {
+                continue;
+            }
+            QImage image;
+            image.loadFromData(images[i]);
+            if (i < m_images.size()) {
+                m_images[i] = image;
+            } else {
+                m_images << image;
+            }
+        }
+        while (m_images.size() > images.size()) {
+            m_images.removeLast();
+        }
     } else if (m_mode == SvgMode) {
-        m_svgRenderer->load(data);
+        for (int i = 0; i < images.size(); ++i) {
+            if (i < m_data.size() && m_data[i] == images[i]) {
+                continue;
+            }
+            if (i >= m_svgRenderers.size()) {
+                m_svgRenderers << new QSvgRenderer(this);
+            }
+            m_svgRenderers[i]->load(images[i]);
+        }
+        while (m_svgRenderers.size() > images.size()) {
+            delete m_svgRenderers.takeLast();
+        }
     }
+    m_data = images;
     zoomImage();
+    setMinimumSize(totalSize(blockSizes(m_zoomScale)));
     update();
 }
 
+QImage PreviewWidget::toImage() const
+{
+    QList<QSize> block_sizes = blockSizes(ZOOM_ORIGINAL_SCALE);
+    QSize output_size = totalSize(block_sizes);
+    if (output_size.isEmpty()) {
+        return QImage();
+    }
+
+    QImage image(output_size, QImage::Format_ARGB32);
+    image.fill(Qt::white);
+    QPainter painter(&image);
+    paintBlocks(&painter, image.rect(), block_sizes, false);
+    return image;
+}
+
 void PreviewWidget::setZoomScale(int zoom_scale)
 {
     if (m_zoomScale != zoom_scale) {
@@ -57,34 +112,77 @@ void PreviewWidget::zoomOut()
 void PreviewWidget::paintEvent(QPaintEvent *)
 {
     QPainter painter(this);
-    QSize output_size;
+    QList<QSize> block_sizes = blockSizes(m_zoomScale);
+    QSize output_size = totalSize(block_sizes);
+    QRect output_rect(QPoint(), output_size);
+    output_rect.translate(rect().center() - output_rect.center());
+    paintBlocks(&painter, output_rect, block_sizes, true);
+    setMinimumSize(output_size);
+}
+
+void PreviewWidget::zoomImage()
+{
     if (m_mode == PngMode) {
-        output_size = m_zoomedImage.size();
-        QRect output_rect(QPoint(), output_size);
-        output_rect.translate(rect().center() - output_rect.center());
-        painter.drawImage(output_rect.topLeft(), m_zoomedImage);
-    } else if (m_mode == SvgMode) {
-        output_size = m_svgRenderer->defaultSize();
-        if (m_zoomScale != ZOOM_ORIGINAL_SCALE) {
-            float zoom = float(m_zoomScale) / ZOOM_ORIGINAL_SCALE;
-            output_size.scale(output_size.width() * zoom, output_size.height() * zoom, Qt::IgnoreAspectRatio);
+        m_zoomedImages.clear();
+        foreach (const QImage& image, m_images) {
+            if (m_zoomScale == ZOOM_ORIGINAL_SCALE) {
+                m_zoomedImages << image;
+            } else {
+                float zoom = float(m_zoomScale) / ZOOM_ORIGINAL_SCALE;
+                m_zoomedImages << image.scaled(image.width() * zoom, image.height() * zoom,
+                                               Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            }
         }
-        QRect output_rect(QPoint(), output_size);
-        output_rect.translate(rect().center() - output_rect.center());
-        m_svgRenderer->render(&painter, output_rect);
     }
-    setMinimumSize(output_size);
 }
 
-void PreviewWidget::zoomImage()
+QList<QSize> PreviewWidget::blockSizes(int zoom_scale) const
 {
+    QList<QSize> sizes;
     if (m_mode == PngMode) {
-        if (m_zoomScale == ZOOM_ORIGINAL_SCALE) {
-            m_zoomedImage = m_image;
-        } else {
-            float zoom = float(m_zoomScale) / ZOOM_ORIGINAL_SCALE;
-            m_zoomedImage = m_image.scaled(m_image.width() * zoom, m_image.height() * zoom,
-                                           Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        const QList<QImage>& images = (zoom_scale == m_zoomScale) ? m_zoomedImages : m_images;
+        foreach (const QImage& image, images) {
+            sizes << image.size();
+        }
+    } else if (m_mode == SvgMode) {
+        float zoom = float(zoom_scale) / ZOOM_ORIGINAL_SCALE;
+        foreach (QSvgRenderer* renderer, m_svgRenderers) {
+            QSize size = renderer->defaultSize();
+            if (zoom_scale != ZOOM_ORIGINAL_SCALE) {
+                size.scale(size.width() * zoom, size.height() * zoom, Qt::IgnoreAspectRatio);
+            }
+            sizes << size;
+        }
+    }
+    return sizes;
+}
+
+QSize PreviewWidget::totalSize(const QList<QSize> &block_sizes) const
+{
+    QSize size;
+    foreach (const QSize& block_size, block_sizes) {
+        size.setWidth(qMax(size.width(), block_size.width()));
+        size.setHeight(size.height() + block_size.height());
+    }
+    if (block_sizes.size() > 1) {
+        size.setHeight(size.height() + BLOCK_SPACING * (block_sizes.size() - 1));
+    }
+    return size;
+}
+
+void PreviewWidget::paintBlocks(QPainter *painter, const QRect &output_rect, const QList<QSize> &block_sizes, bool zoomed) const
+{
+    // the blocks are centered horizontally, one below the other
+    int top = output_rect.top();
+    for (int i = 0; i < block_sizes.size(); ++i) {
+        QRect block_rect(QPoint(), block_sizes[i]);
+        block_rect.moveTop(top);
+        block_rect.moveLeft(output_rect.left() + (output_rect.width() - block_rect.width()) / 2);
+        if (m_mode == PngMode) {
+            painter->drawImage(block_rect.topLeft(), zoomed ? m_zoomedImages[i] : m_images[i]);
+        } else if (m_mode == SvgMode) {
+            m_svgRenderers[i]->render(painter, block_rect);
         }
+        top += block_rect.height() + BLOCK_SPACING;
     }
 }
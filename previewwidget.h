@@ -3,6 +3,7 @@
 
 #include <QWidget>
 #include <QImage>
+#include <QList>
 
 class QSvgRenderer;
 
@@ -18,6 +19,10 @@ public:
     void setMode(Mode new_mode) { m_mode = new_mode; }
 
     void load(const QByteArray &data);
+    // shows the images one below the other, decoding only the changed ones
+    void load(const QList<QByteArray> &images);
+
+    QImage toImage() const; //< all images stitched together, at 100%
 
 public slots:
     void zoomOriginal() { setZoomScale(ZOOM_ORIGINAL_SCALE); }
@@ -30,11 +35,16 @@ private:
     void paintEvent(QPaintEvent *);
     void zoomImage();
     void setZoomScale(int new_scale);
+    QList<QSize> blockSizes(int zoom_scale) const;
+    QSize totalSize(const QList<QSize> &block_sizes) const;
+    void paintBlocks(QPainter *painter, const QRect &output_rect, const QList<QSize> &block_sizes, bool zoomed) const;
 
-    QImage m_image;
-    QImage m_zoomedImage;
+    QList<QByteArray> m_data;
+    QList<QImage> m_images;
+    QList<QImage> m_zoomedImages;
     Mode m_mode;
-    QSvgRenderer *m_svgRenderer;
+    Mode m_loadedMode; // of m_data
+    QList<QSvgRenderer*> m_svgRenderers;
     int m_zoomScale;
 };
 
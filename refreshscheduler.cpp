@@ -0,0 +1,75 @@
+#include "refreshscheduler.h"
+#include <QTimer>
+
+//------------------------------------------------------------------------------
+
+RefreshScheduler::RefreshScheduler(QObject *parent)
+    : QObject(parent)
+    , m_enabled(false)
+    , m_idleTimer(new QTimer(this))
+    , m_maxTimer(new QTimer(this))
+{
+    m_idleTimer->setSingleShot(true);
+    m_maxTimer->setSingleShot(true);
+    connect(m_idleTimer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+    connect(m_maxTimer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+}
+
+void RefreshScheduler::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    if (!m_enabled) {
+        cancel();
+    }
+}
+
+int RefreshScheduler::idleDelay() const
+{
+    return m_idleTimer->interval();
+}
+
+void RefreshScheduler::setIdleDelay(int msec)
+{
+    m_idleTimer->setInterval(msec);
+}
+
+int RefreshScheduler::maxDelay() const
+{
+    return m_maxTimer->interval();
+}
+
+void RefreshScheduler::setMaxDelay(int msec)
+{
+    m_maxTimer->setInterval(msec);
+}
+
+bool RefreshScheduler::isPending() const
+{
+    return m_idleTimer->isActive() || m_maxTimer->isActive();
+}
+
+void RefreshScheduler::documentChanged()
+{
+    if (!m_enabled) {
+        return;
+    }
+
+    m_idleTimer->start(); // restarts the countdown
+    if (!m_maxTimer->isActive() && m_maxTimer->interval() > m_idleTimer->interval()) {
+        m_maxTimer->start(); // but only the first change of a burst sets the deadline
+    }
+}
+
+void RefreshScheduler::cancel()
+{
+    m_idleTimer->stop();
+    m_maxTimer->stop();
+}
+
+void RefreshScheduler::onTimeout()
+{
+    cancel();
+    emit triggered();
+}
+
+//------------------------------------------------------------------------------
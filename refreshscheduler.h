@@ -0,0 +1,49 @@
+#ifndef REFRESHSCHEDULER_H
+#define REFRESHSCHEDULER_H
+
+#include <QObject>
+
+class QTimer;
+
+//------------------------------------------------------------------------------
+
+// Turns a burst of document changes into a single refresh. triggered() is
+// emitted once the changes pause for idleDelay() milliseconds, or at the
+// latest maxDelay() milliseconds after the first change of the burst, so the
+// preview keeps up with continuous typing. Nothing runs while the document
+// doesn't change.
+class RefreshScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RefreshScheduler(QObject* parent = 0);
+
+    bool isEnabled() const { return m_enabled; }
+    void setEnabled(bool enabled);
+
+    int idleDelay() const;
+    void setIdleDelay(int msec);
+    int maxDelay() const;
+    void setMaxDelay(int msec);
+
+    bool isPending() const;
+
+signals:
+    void triggered();
+
+public slots:
+    void documentChanged();
+    void cancel();
+
+private slots:
+    void onTimeout();
+
+private:
+    bool m_enabled;
+    QTimer* m_idleTimer;
+    QTimer* m_maxTimer;
+};
+
+//------------------------------------------------------------------------------
+
+#endif // REFRESHSCHEDULER_H
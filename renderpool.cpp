@@ -0,0 +1,314 @@
+#include "renderpool.h"
+#include "httprenderworker.h"
+#include "picowebserver.h"
+#include <QThread>
+
+//------------------------------------------------------------------------------
+
+RenderPool::RenderPool(int size, QObject *parent)
+    : QObject(parent)
+    , m_backend(PipeBackend)
+    , m_maxOutputSize(0)
+    , m_timeout(0)
+    , m_captureThreadDumps(false)
+    , m_keepRunning(true)
+    , m_outputWriter(0)
+{
+    m_server = new PicowebServer(this);
+    setSize(size);
+}
+
+RenderPool::~RenderPool()
+{
+    // the workers go before the server they may use
+    qDeleteAll(m_workers);
+    m_workers.clear();
+}
+
+void RenderPool::setBackend(RenderPool::Backend backend)
+{
+    if (m_backend == backend) {
+        return;
+    }
+    m_backend = backend;
+
+    QList<RenderJob*> orphans;
+    foreach (AbstractRenderWorker* worker, m_workers) {
+        worker->stop();
+        orphans << worker->takeQueuedJobs();
+        worker->deleteLater();
+    }
+    const int size = m_workers.size();
+    m_workers.clear();
+    if (m_backend != HttpBackend) {
+        m_server->stop();
+    }
+
+    setSize(size);
+    foreach (RenderJob* job, orphans) {
+        workerFor(job)->render(job);
+    }
+    emitOccupancyChanged();
+}
+
+int RenderPool::serverPort() const
+{
+    return m_server->requestedPort();
+}
+
+void RenderPool::setServerPort(int port)
+{
+    m_server->setRequestedPort(port);
+}
+
+void RenderPool::setSize(int size)
+{
+    if (size <= 0) {
+        size = qMax(1, QThread::idealThreadCount());
+    }
+
+    while (m_workers.size() < size) {
+        m_workers << createWorker();
+    }
+
+    QList<RenderJob*> orphans;
+    while (m_workers.size() > size) {
+        AbstractRenderWorker* worker = m_workers.takeLast();
+        worker->stop(); // puts the job in flight back in the queue
+        orphans << worker->takeQueuedJobs();
+        worker->deleteLater();
+    }
+    foreach (RenderJob* job, orphans) {
+        workerFor(job)->render(job);
+    }
+
+    emitOccupancyChanged();
+}
+
+int RenderPool::busyCount() const
+{
+    int count = 0;
+    foreach (AbstractRenderWorker* worker, m_workers) {
+        if (worker->isBusy()) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void RenderPool::setSettings(const RenderSettings &settings)
+{
+    m_settings = settings;
+    m_server->setSettings(settings);
+    foreach (AbstractRenderWorker* worker, m_workers) {
+        worker->setSettings(settings);
+    }
+}
+
+void RenderPool::setMaxOutputSize(qint64 size)
+{
+    m_maxOutputSize = size;
+    foreach (AbstractRenderWorker* worker, m_workers) {
+        worker->setMaxOutputSize(size);
+    }
+}
+
+void RenderPool::setTimeout(int msec)
+{
+    m_timeout = msec;
+    foreach (AbstractRenderWorker* worker, m_workers) {
+        worker->setTimeout(msec);
+    }
+}
+
+void RenderPool::setCaptureThreadDumps(bool capture)
+{
+    m_captureThreadDumps = capture;
+    foreach (AbstractRenderWorker* worker, m_workers) {
+        worker->setCaptureThreadDumps(capture);
+    }
+}
+
+void RenderPool::setKeepRunning(bool keep_running)
+{
+    m_keepRunning = keep_running;
+    foreach (AbstractRenderWorker* worker, m_workers) {
+        if (RenderWorker* pipe_worker = qobject_cast<RenderWorker*>(worker)) {
+            pipe_worker->setKeepRunning(keep_running);
+        }
+    }
+}
+
+void RenderPool::setOutputWriter(FileCacheWriter *writer)
+{
+    m_outputWriter = writer;
+    foreach (AbstractRenderWorker* worker, m_workers) {
+        worker->setOutputWriter(writer);
+    }
+}
+
+void RenderPool::render(RenderJob *job)
+{
+    RenderJob* flight = m_flights.value(job->key());
+    if (flight) {
+        job->setParent(this);
+        job->m_state = RenderJob::Queued;
+        m_waiters[flight] << job;
+        if (job->priority() > flight->priority()) {
+            // the job it waits for becomes just as urgent
+            bool queued = false;
+            foreach (AbstractRenderWorker* worker, m_workers) {
+                if (worker->raisePriority(flight, job->priority())) {
+                    queued = true;
+                    break;
+                }
+            }
+            if (!queued) {
+                flight->m_priority = job->priority();
+            }
+        }
+        return;
+    }
+
+    m_flights.insert(job->key(), job);
+    workerFor(job)->render(job);
+    emitOccupancyChanged();
+}
+
+bool RenderPool::cancel(RenderJob *job)
+{
+    RenderJob* flight = m_flights.value(job->key());
+    if (flight && flight != job) {
+        if (!m_waiters[flight].removeOne(job)) {
+            return false;
+        }
+        if (m_waiters[flight].isEmpty()) {
+            m_waiters.remove(flight);
+        }
+        job->deleteLater();
+        return true;
+    }
+
+    foreach (AbstractRenderWorker* worker, m_workers) {
+        if (worker->cancel(job)) {
+            m_flights.remove(job->key());
+            // the jobs waiting for it are still wanted: the first one is
+            // rendered instead
+            QList<RenderJob*> waiters = m_waiters.take(job);
+            if (!waiters.isEmpty()) {
+                RenderJob* next = waiters.takeFirst();
+                m_flights.insert(next->key(), next);
+                if (!waiters.isEmpty()) {
+                    m_waiters.insert(next, waiters);
+                }
+                workerFor(next)->render(next);
+            }
+            emitOccupancyChanged();
+            return true;
+        }
+    }
+    return false;
+}
+
+int RenderPool::waiterCount() const
+{
+    int count = 0;
+    foreach (const QList<RenderJob*>& waiters, m_waiters) {
+        count += waiters.size();
+    }
+    return count;
+}
+
+void RenderPool::onWorkerJobFinished(RenderJob *job)
+{
+    AbstractRenderWorker* worker = qobject_cast<AbstractRenderWorker*>(sender());
+
+    if (m_flights.value(job->key()) == job) {
+        m_flights.remove(job->key());
+    }
+    emit jobFinished(job);
+    finishWaiters(job);
+
+    if (worker && worker->queueSize() == 0) {
+        stealWork(worker);
+    }
+    emitOccupancyChanged();
+}
+
+AbstractRenderWorker *RenderPool::createWorker()
+{
+    AbstractRenderWorker* worker;
+    if (m_backend == HttpBackend) {
+        worker = new HttpRenderWorker(m_server, this);
+    } else {
+        RenderWorker* pipe_worker = new RenderWorker(this);
+        pipe_worker->setKeepRunning(m_keepRunning);
+        worker = pipe_worker;
+    }
+    worker->setSettings(m_settings);
+    worker->setMaxOutputSize(m_maxOutputSize);
+    worker->setTimeout(m_timeout);
+    worker->setCaptureThreadDumps(m_captureThreadDumps);
+    if (m_outputWriter) {
+        worker->setOutputWriter(m_outputWriter);
+    }
+    connect(worker, SIGNAL(jobFinished(RenderJob*)), this, SLOT(onWorkerJobFinished(RenderJob*)));
+    return worker;
+}
+
+AbstractRenderWorker *RenderPool::workerFor(const RenderJob *job) const
+{
+    // lower is better: idle before busy, short queues first, warm before cold;
+    // the queued jobs of a lower priority will run after this one anyway
+    AbstractRenderWorker* best = 0;
+    int best_score = 0;
+    foreach (AbstractRenderWorker* worker, m_workers) {
+        int score = worker->isWarmFor(job->format()) ? 0 : 1;
+        if (worker->isBusy()) {
+            score += (1 + worker->queueSize(job->priority())) * 2;
+        }
+        if (!best || score < best_score) {
+            best = worker;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+void RenderPool::stealWork(AbstractRenderWorker *thief)
+{
+    AbstractRenderWorker* victim = 0;
+    foreach (AbstractRenderWorker* worker, m_workers) {
+        if (worker != thief && worker->queueSize() > 0 &&
+                (!victim || worker->queueSize() > victim->queueSize())) {
+            victim = worker;
+        }
+    }
+
+    if (victim) {
+        thief->render(victim->stealJob());
+    }
+}
+
+void RenderPool::emitOccupancyChanged()
+{
+    emit occupancyChanged(busyCount(), size());
+}
+
+void RenderPool::finishWaiters(RenderJob *job)
+{
+    foreach (RenderJob* waiter, m_waiters.take(job)) {
+        waiter->m_state = job->m_state;
+        waiter->m_output = job->m_output; // shared, not copied
+        waiter->m_errorString = job->m_errorString;
+        waiter->m_timedOut = job->m_timedOut;
+        waiter->m_attempts = job->m_attempts;
+        // nothing was written there, the image went to the job's own file
+        waiter->m_outputPath.clear();
+
+        emit jobFinished(waiter);
+        waiter->deleteLater();
+    }
+}
+
+//------------------------------------------------------------------------------
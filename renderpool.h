@@ -0,0 +1,94 @@
+#ifndef RENDERPOOL_H
+#define RENDERPOOL_H
+
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include "renderworker.h"
+
+class PicowebServer;
+
+//------------------------------------------------------------------------------
+
+// A set of warm render workers, each with its own job queue. New jobs go to
+// the worker that can start them the soonest, preferring one whose PlantUML
+// process already runs the right format. A worker that runs out of jobs
+// steals the most recently queued job of the busiest worker.
+//
+// With the HTTP backend, the workers share one PlantUML server instead of
+// running a process each, and any worker is warm once the server listens.
+//
+// An urgent job goes to the worker with the fewest jobs of the same or a higher
+// priority ahead of it, background jobs never hold it back for long.
+//
+// Jobs are coalesced by key: a job given while another one with the same key
+// is queued or running waits for it instead of being rendered again, and gets
+// a copy of its result. jobFinished() is emitted for both.
+class RenderPool : public QObject
+{
+    Q_OBJECT
+public:
+    enum Backend { PipeBackend, HttpBackend };
+
+    explicit RenderPool(int size = 0, QObject* parent = 0);
+    virtual ~RenderPool();
+
+    Backend backend() const { return m_backend; }
+    void setBackend(Backend backend); //< the queued jobs move to the new workers
+    int serverPort() const;
+    void setServerPort(int port); //< for the HTTP backend, 0 means any free port
+
+    int size() const { return m_workers.size(); }
+    void setSize(int size); //< 0 means one worker per core
+    int busyCount() const;
+
+    const RenderSettings& settings() const { return m_settings; }
+    void setSettings(const RenderSettings& settings);
+    void setMaxOutputSize(qint64 size);
+    void setTimeout(int msec); //< 0 means no limit
+    void setCaptureThreadDumps(bool capture);
+    void setKeepRunning(bool keep_running);
+    // given to the workers for the output files of the jobs, before the first
+    // job is rendered
+    void setOutputWriter(FileCacheWriter* writer);
+
+    void render(RenderJob* job);
+    // Drops a job that is still queued, or waiting for another one. A job in
+    // flight can't be taken back, it finishes normally.
+    bool cancel(RenderJob* job);
+
+    bool isInFlight(const QString& key) const { return m_flights.contains(key); }
+    int waiterCount() const;
+
+signals:
+    void jobFinished(RenderJob* job);
+    void occupancyChanged(int busy, int size);
+
+private slots:
+    void onWorkerJobFinished(RenderJob* job);
+
+private:
+    AbstractRenderWorker* createWorker();
+    AbstractRenderWorker* workerFor(const RenderJob* job) const;
+    void stealWork(AbstractRenderWorker* thief);
+    void emitOccupancyChanged();
+    void finishWaiters(RenderJob* job);
+
+    Backend m_backend;
+    PicowebServer* m_server;
+
+    RenderSettings m_settings;
+    qint64 m_maxOutputSize;
+    int m_timeout;
+    bool m_captureThreadDumps;
+    bool m_keepRunning;
+    FileCacheWriter* m_outputWriter;
+    QList<AbstractRenderWorker*> m_workers;
+    // the job rendered for each key, and the jobs waiting for it
+    QHash<QString, RenderJob*> m_flights;
+    QHash<RenderJob*, QList<RenderJob*> > m_waiters;
+};
+
+//------------------------------------------------------------------------------
+
+#endif // RENDERPOOL_H
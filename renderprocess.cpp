@@ -0,0 +1,77 @@
+#include "renderprocess.h"
+#include <QStringList>
+
+#if defined(Q_OS_UNIX)
+#include <sys/types.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+//------------------------------------------------------------------------------
+
+RenderProcess::RenderProcess(QObject *parent)
+    : QProcess(parent)
+{
+}
+
+void RenderProcess::killTree()
+{
+    const qint64 pid = processIdentifier();
+    if (pid > 0) {
+#if defined(Q_OS_UNIX)
+        ::kill(-static_cast<pid_t>(pid), SIGKILL);
+#elif defined(Q_OS_WIN)
+        // not waited for, the editor would hang meanwhile; java is left to it,
+        // as taskkill only finds the programs it started through it
+        if (QProcess::startDetached("taskkill", QStringList() << "/T" << "/F" << "/PID" << QString::number(pid))) {
+            return; // anything left is killed when the process is deleted
+        }
+#endif
+    }
+    kill();
+}
+
+bool RenderProcess::requestThreadDump()
+{
+#if defined(Q_OS_UNIX)
+    const qint64 pid = processIdentifier();
+    return pid > 0 && ::kill(static_cast<pid_t>(pid), SIGQUIT) == 0;
+#else
+    return false;
+#endif
+}
+
+void RenderProcess::addEnvironment(const QStringList &variables)
+{
+    if (variables.isEmpty()) {
+        return;
+    }
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    foreach (const QString& variable, variables) {
+        environment.insert(variable.section('=', 0, 0), variable.section('=', 1));
+    }
+    setProcessEnvironment(environment);
+}
+
+void RenderProcess::setupChildProcess()
+{
+#if defined(Q_OS_UNIX)
+    ::setpgid(0, 0);
+#endif
+}
+
+qint64 RenderProcess::processIdentifier() const
+{
+    if (state() == QProcess::NotRunning) {
+        return 0;
+    }
+#if QT_VERSION >= QT_VERSION_CHECK(5,3,0)
+    return processId();
+#elif defined(Q_OS_WIN)
+    return pid() ? pid()->dwProcessId : 0;
+#else
+    return pid();
+#endif
+}
+
+//------------------------------------------------------------------------------
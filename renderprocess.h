@@ -0,0 +1,34 @@
+#ifndef RENDERPROCESS_H
+#define RENDERPROCESS_H
+
+#include <QProcess>
+#include <QStringList>
+
+//------------------------------------------------------------------------------
+
+// A java process that can be killed along with the programs it started (dot
+// for PlantUML): on Unix it runs in a process group of its own.
+class RenderProcess : public QProcess
+{
+public:
+    explicit RenderProcess(QObject* parent = 0);
+
+    // on Windows the tree may still be going away after it returns, until
+    // the process is deleted
+    void killTree();
+    // Asks the JVM to print the stack of all its threads on its standard
+    // output. False if this can't be done on this platform.
+    bool requestThreadDump();
+    // sets these "NAME=value" variables on top of the inherited environment
+    void addEnvironment(const QStringList& variables);
+
+protected:
+    virtual void setupChildProcess();
+
+private:
+    qint64 processIdentifier() const;
+};
+
+//------------------------------------------------------------------------------
+
+#endif // RENDERPROCESS_H
@@ -0,0 +1,615 @@
+#include "renderworker.h"
+#include "diagramsource.h"
+#include "renderprocess.h"
+#include "filecache.h"
+#include <QStringList>
+#include <QTimer>
+#include <QDebug>
+
+//------------------------------------------------------------------------------
+
+namespace {
+// printed by PlantUML after every diagram it renders in -pipe mode
+const QByteArray FRAME_DELIMITER = "--plantumlqeditor-end-of-diagram--";
+// with -pipeNoStderr, syntax errors are reported on stdout instead of the image
+const QByteArray ERROR_FRAME_PREFIX = "ERROR";
+// a job survives one crash of the PlantUML process
+const int MAX_JOB_ATTEMPTS = 2;
+// a warm process gets a few jobs at a time, so the others can still be
+// cancelled or stolen by another worker
+const int MAX_BATCH_SIZE = 8;
+// a more urgent job never waits for more than one background job
+const int MAX_BACKGROUND_BATCH_SIZE = 1;
+// what is kept of the JVM messages for the error of a job that timed out
+const int STDERR_TAIL_SIZE = 4096;
+const int MAX_THREAD_DUMP_SIZE = 64 * 1024;
+// how long the JVM is given to print its threads before it is killed
+const int THREAD_DUMP_GRACE = 1000; // in miliseconds
+// how the JVM begins a thread dump on its standard output
+const QByteArray THREAD_DUMP_HEADER = "Full thread dump";
+
+void removeLeadingLineSeparators(QByteArray& data)
+{
+    int count = 0;
+    while (count < data.size() && (data.at(count) == '\r' || data.at(count) == '\n')) {
+        ++count;
+    }
+    data.remove(0, count);
+}
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+bool RenderSettings::operator==(const RenderSettings &other) const
+{
+    return javaPath == other.javaPath &&
+            plantUmlPath == other.plantUmlPath &&
+            graphizPath == other.graphizPath &&
+            workingDirectory == other.workingDirectory &&
+            javaOptions == other.javaOptions &&
+            environment == other.environment;
+}
+
+//------------------------------------------------------------------------------
+
+RenderJob::RenderJob(const QString &key, const QByteArray &document, const QString &format, QObject *parent)
+    : QObject(parent)
+    , m_state(Queued)
+    , m_priority(InteractivePriority)
+    , m_key(key)
+    , m_document(document)
+    , m_format(format)
+    , m_timedOut(false)
+    , m_attempts(0)
+    , m_pendingFrames(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+AbstractRenderWorker::AbstractRenderWorker(QObject *parent)
+    : QObject(parent)
+    , m_maxOutputSize(0)
+    , m_timeout(0)
+    , m_captureThreadDumps(false)
+    , m_dispatchScheduled(false)
+    , m_outputWriter(0)
+{
+}
+
+AbstractRenderWorker::~AbstractRenderWorker()
+{
+}
+
+FileCacheWriter *AbstractRenderWorker::outputWriter()
+{
+    if (!m_outputWriter) {
+        m_outputWriter = new FileCacheWriter(this);
+    }
+    return m_outputWriter;
+}
+
+void AbstractRenderWorker::setSettings(const RenderSettings &settings)
+{
+    m_settings = settings;
+}
+
+void AbstractRenderWorker::render(RenderJob *job)
+{
+    job->setParent(this);
+    job->m_state = RenderJob::Queued;
+    enqueue(job);
+    scheduleDispatch();
+}
+
+int AbstractRenderWorker::queueSize(RenderJob::Priority priority) const
+{
+    int count = 0;
+    while (count < m_queue.size() && m_queue.at(count)->priority() >= priority) {
+        ++count;
+    }
+    return count;
+}
+
+RenderJob *AbstractRenderWorker::stealJob()
+{
+    if (m_queue.isEmpty()) {
+        return 0;
+    }
+    // the queue is sorted, its head has the highest priority
+    int index = 0;
+    while (index + 1 < m_queue.size() && m_queue.at(index + 1)->priority() == m_queue.head()->priority()) {
+        ++index;
+    }
+    return m_queue.takeAt(index);
+}
+
+bool AbstractRenderWorker::raisePriority(RenderJob *job, RenderJob::Priority priority)
+{
+    if (!m_queue.removeOne(job)) {
+        return false;
+    }
+    job->m_priority = qMax(job->m_priority, priority);
+    enqueue(job);
+    scheduleDispatch(); // it may preempt the running jobs now
+    return true;
+}
+
+bool AbstractRenderWorker::cancel(RenderJob *job)
+{
+    if (!m_queue.removeOne(job)) {
+        return false;
+    }
+    job->deleteLater();
+    return true;
+}
+
+QList<RenderJob *> AbstractRenderWorker::takeQueuedJobs()
+{
+    QList<RenderJob*> jobs = m_queue;
+    m_queue.clear();
+    return jobs;
+}
+
+void AbstractRenderWorker::enqueue(RenderJob *job)
+{
+    int index = m_queue.size();
+    while (index > 0 && m_queue.at(index - 1)->priority() < job->priority()) {
+        --index;
+    }
+    m_queue.insert(index, job);
+}
+
+void AbstractRenderWorker::requeue(RenderJob *job)
+{
+    int index = 0;
+    while (index < m_queue.size() && m_queue.at(index)->priority() > job->priority()) {
+        ++index;
+    }
+    m_queue.insert(index, job);
+}
+
+void AbstractRenderWorker::scheduleDispatch()
+{
+    if (!m_dispatchScheduled) {
+        m_dispatchScheduled = true;
+        QMetaObject::invokeMethod(this, "dispatch", Qt::QueuedConnection);
+    }
+}
+
+void AbstractRenderWorker::dispatch()
+{
+    m_dispatchScheduled = false;
+    processNext();
+}
+
+//------------------------------------------------------------------------------
+
+RenderWorker::RenderWorker(QObject *parent)
+    : AbstractRenderWorker(parent)
+    , m_settingsChanged(false)
+    , m_keepRunning(true)
+    , m_process(0)
+    , m_processStarted(false)
+    , m_inputClosed(false)
+    , m_scanned(0)
+    , m_written(0)
+    , m_watchedJob(0)
+    , m_threadDumpRequested(false)
+{
+    m_watchdog = new QTimer(this);
+    m_watchdog->setSingleShot(true);
+    connect(m_watchdog, SIGNAL(timeout()), this, SLOT(onWatchdogTimeout()));
+}
+
+RenderWorker::~RenderWorker()
+{
+    stop();
+}
+
+void RenderWorker::setSettings(const RenderSettings &settings)
+{
+    if (m_settings != settings) {
+        m_settings = settings;
+        // the running process (if any) is replaced before the next batch
+        m_settingsChanged = true;
+    }
+}
+
+void RenderWorker::setKeepRunning(bool keep_running)
+{
+    m_keepRunning = keep_running;
+}
+
+void RenderWorker::stop()
+{
+    if (m_process) {
+        m_process->disconnect(this);
+        m_process->killTree();
+        m_process->deleteLater();
+        m_process = 0;
+    }
+    m_processStarted = false;
+    m_inputClosed = false;
+    m_buffer.clear();
+    m_scanned = 0;
+    m_written = 0;
+    discardOutputFile();
+
+    // give the batch another chance, with a new process
+    requeueRunningJobs();
+    if (!m_queue.isEmpty()) {
+        m_queue.head()->m_state = RenderJob::Queued; // it may have been Starting
+    }
+    updateWatchdog();
+}
+
+void RenderWorker::onProcessStarted()
+{
+    m_processStarted = true;
+    processNext();
+}
+
+void RenderWorker::onProcessReadyReadStandardOutput()
+{
+    m_buffer.append(m_process->readAllStandardOutput());
+
+    while (!m_runningJobs.isEmpty()) {
+        RenderJob* job = m_runningJobs.head();
+        if (m_scanned == 0) {
+            removeLeadingLineSeparators(m_buffer);
+        }
+
+        int index = m_buffer.indexOf(FRAME_DELIMITER, m_scanned);
+        if (index < 0) {
+            // only the last bytes may be the beginning of a delimiter
+            m_scanned = qMax(0, m_buffer.size() - FRAME_DELIMITER.size() + 1);
+            if (checkOutputSize()) {
+                writeOutput(m_scanned, false);
+            }
+            break;
+        }
+
+        // the frame keeps the buffer, only what follows it is copied
+        QByteArray rest = m_buffer.mid(index + FRAME_DELIMITER.size());
+        m_buffer.truncate(index);
+        if (!checkOutputSize()) {
+            break;
+        }
+
+        if (m_buffer.startsWith(ERROR_FRAME_PREFIX)) {
+            job->m_errorString.append(QString::fromUtf8(m_buffer));
+        } else {
+            writeOutput(m_buffer.size(), true);
+            if (job->m_output.isEmpty()) {
+                job->m_output = m_buffer;
+            } else {
+                job->m_output.append(m_buffer);
+            }
+        }
+        m_buffer = rest;
+        m_scanned = 0;
+        m_written = 0;
+
+        if (--job->m_pendingFrames == 0) {
+            finishCurrentJob(job->m_errorString);
+        }
+    }
+
+    if (m_runningJobs.isEmpty()) {
+        m_buffer.clear(); // nobody is waiting for it
+        m_scanned = 0;
+        m_written = 0;
+    }
+}
+
+void RenderWorker::onProcessReadyReadStandardError()
+{
+    // only the JVM writes here when -pipeNoStderr is used; don't let it pile up
+    QByteArray message = m_process->readAllStandardError();
+    qDebug() << "render process:" << message.trimmed();
+    m_stderrTail.append(message);
+    if (m_stderrTail.size() > STDERR_TAIL_SIZE) {
+        m_stderrTail.remove(0, m_stderrTail.size() - STDERR_TAIL_SIZE);
+    }
+}
+
+void RenderWorker::onProcessFinished(int exit_code, QProcess::ExitStatus exit_status)
+{
+    processDied(exit_status == QProcess::CrashExit ?
+                    tr("PlantUML crashed") :
+                    tr("PlantUML exited with code %1").arg(exit_code));
+}
+
+void RenderWorker::onProcessError(QProcess::ProcessError error)
+{
+    if (error != QProcess::FailedToStart) {
+        return; // the other errors are followed by finished()
+    }
+
+    QString reason = tr("Failed to start %1: %2").arg(m_settings.javaPath).arg(m_process->errorString());
+    stop();
+
+    // restarting would fail again, so fail everything that is waiting
+    QQueue<RenderJob*> failed_jobs = m_queue;
+    m_queue.clear();
+    foreach (RenderJob* job, failed_jobs) {
+        finishJob(job, reason);
+    }
+}
+
+void RenderWorker::onWatchdogTimeout()
+{
+    if (m_runningJobs.isEmpty() || !m_process) {
+        return;
+    }
+
+    // the JVM prints its threads on stdout, where they are read as if they
+    // were the image
+    if (m_captureThreadDumps && !m_threadDumpRequested && m_process->requestThreadDump()) {
+        m_threadDumpRequested = true;
+        m_watchdog->start(THREAD_DUMP_GRACE);
+        return;
+    }
+
+    RenderJob* job = m_runningJobs.dequeue();
+    const QString diagnostics = timeoutDiagnostics();
+    qDebug() << "render job timed out after" << m_watchedTime.elapsed() << "ms:" << job->key();
+
+    // dot may be the one stuck, it goes with the process
+    stop();
+    job->m_timedOut = true;
+    finishJob(job, diagnostics); // not retried, it would hang again
+}
+
+void RenderWorker::startProcess(const QString &format)
+{
+    m_settingsChanged = false;
+    m_processFormat = format;
+    m_processStarted = false;
+    m_inputClosed = false;
+    m_buffer.clear();
+    m_stderrTail.clear();
+
+    QStringList arguments;
+    arguments << m_settings.javaOptions
+              << "-jar" << m_settings.plantUmlPath
+              << QString("-t%1").arg(format);
+    if (!m_settings.graphizPath.isEmpty()) {
+        arguments << "-graphizdot" << m_settings.graphizPath;
+    }
+    arguments << "-charset" << "UTF-8"
+              << "-pipe" << "-pipeNoStderr"
+              << "-pipedelimitor" << QString::fromLatin1(FRAME_DELIMITER);
+
+    m_process = new RenderProcess(this);
+    m_process->setWorkingDirectory(m_settings.workingDirectory);
+    m_process->addEnvironment(m_settings.environment);
+
+    connect(m_process, SIGNAL(started()), this, SLOT(onProcessStarted()));
+    connect(m_process, SIGNAL(readyReadStandardOutput()), this, SLOT(onProcessReadyReadStandardOutput()));
+    connect(m_process, SIGNAL(readyReadStandardError()), this, SLOT(onProcessReadyReadStandardError()));
+    connect(m_process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(onProcessFinished(int,QProcess::ExitStatus)));
+    connect(m_process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(onProcessError(QProcess::ProcessError)));
+
+    qDebug() << "starting render process for" << format;
+    m_process->start(m_settings.javaPath, arguments);
+}
+
+void RenderWorker::processNext()
+{
+    if (m_queue.isEmpty()) {
+        return;
+    }
+    if (!m_runningJobs.isEmpty()) {
+        // A more urgent job doesn't wait for a background batch when a new
+        // process has to be started after it anyway. A kept running process
+        // is worth more than the one background job it renders.
+        if (m_keepRunning || m_queue.head()->priority() <= m_runningJobs.head()->priority()) {
+            return; // one batch at a time
+        }
+        qDebug() << "preempting" << m_runningJobs.size() << "background jobs";
+        stop();
+    }
+
+    const QString format = m_queue.head()->format();
+    if (m_process && (m_settingsChanged || m_processFormat != format || m_inputClosed)) {
+        stop();
+    }
+    if (!m_process) {
+        startProcess(format);
+    }
+    if (!m_processStarted) {
+        // the start may already have failed, and taken the queue with it
+        if (!m_queue.isEmpty()) {
+            m_queue.head()->m_state = RenderJob::Starting;
+        }
+        return; // onProcessStarted() will get us back here
+    }
+
+    // the next jobs for the same format and priority all go in one write
+    const RenderJob::Priority priority = m_queue.head()->priority();
+    int batch_size = m_keepRunning ? MAX_BATCH_SIZE : m_queue.size();
+    if (priority == RenderJob::BackgroundPriority) {
+        batch_size = MAX_BACKGROUND_BATCH_SIZE;
+    }
+    QByteArray input;
+    QList<RenderJob*> empty_jobs;
+    while (!m_queue.isEmpty() && m_runningJobs.size() + empty_jobs.size() < batch_size &&
+           m_queue.head()->format() == format && m_queue.head()->priority() == priority) {
+        RenderJob* job = m_queue.dequeue();
+        job->m_state = RenderJob::Running;
+        job->m_attempts++;
+        job->m_output.clear();
+        job->m_errorString.clear();
+
+        QList<QByteArray> diagrams = splitDiagrams(job->document());
+        job->m_pendingFrames = diagrams.size();
+        if (diagrams.isEmpty()) {
+            empty_jobs << job; // nothing to wait for
+            continue;
+        }
+        m_runningJobs.enqueue(job);
+        foreach (const QByteArray& diagram, diagrams) {
+            input.append(diagram);
+        }
+    }
+
+    if (!m_runningJobs.isEmpty()) {
+        m_process->write(input);
+        if (!m_keepRunning) {
+            m_process->closeWriteChannel(); // it exits after this batch
+            m_inputClosed = true;
+        }
+        updateWatchdog();
+    }
+
+    foreach (RenderJob* job, empty_jobs) {
+        finishJob(job, QString());
+    }
+}
+
+void RenderWorker::finishCurrentJob(const QString &error_string)
+{
+    finishJob(m_runningJobs.dequeue(), error_string);
+}
+
+void RenderWorker::finishJob(RenderJob *job, const QString &error_string)
+{
+    job->m_pendingFrames = 0;
+    job->m_errorString = error_string;
+    if (job->hasError()) {
+        job->m_state = RenderJob::Failed;
+        job->m_output.clear();
+        discardOutputFile();
+    } else {
+        job->m_state = RenderJob::Done;
+        if (m_outputFilePath.isEmpty()) {
+            job->m_outputPath.clear(); // nothing to write
+        }
+        m_outputFilePath.clear();
+    }
+
+    updateWatchdog();
+    emit jobFinished(job);
+    job->deleteLater();
+
+    processNext();
+}
+
+void RenderWorker::processDied(const QString &reason)
+{
+    if (m_runningJobs.isEmpty()) {
+        // nothing was lost, it may even have been expected
+        stop();
+        processNext();
+        return;
+    }
+
+    qDebug() << "render process died:" << reason;
+
+    // only the job being read is to blame, the rest of the batch goes back
+    // to the queue as if it was never written
+    RenderJob* job = m_runningJobs.dequeue();
+    stop();
+
+    if (job->attempts() < MAX_JOB_ATTEMPTS) {
+        job->m_state = RenderJob::Queued;
+        requeue(job);
+        processNext(); // restarts the process
+    } else {
+        finishJob(job, reason);
+    }
+}
+
+void RenderWorker::requeueRunningJobs()
+{
+    while (!m_runningJobs.isEmpty()) {
+        RenderJob* job = m_runningJobs.takeLast();
+        job->m_attempts--; // its turn never came
+        job->m_state = RenderJob::Queued;
+        requeue(job);
+    }
+}
+
+bool RenderWorker::checkOutputSize()
+{
+    RenderJob* job = m_runningJobs.head();
+    if (m_maxOutputSize <= 0 || job->m_output.size() + m_buffer.size() <= m_maxOutputSize) {
+        return true;
+    }
+
+    // the rest of the image would still have to be read: restart the process
+    m_runningJobs.dequeue();
+    stop();
+    finishJob(job, tr("The image is larger than the limit of %1 bytes").arg(m_maxOutputSize));
+    return false;
+}
+
+void RenderWorker::writeOutput(int end, bool frame_complete)
+{
+    RenderJob* job = m_runningJobs.head();
+    // an error message can only be told apart from an image by how it begins
+    if (end <= m_written || job->m_outputPath.isEmpty() ||
+            (!frame_complete && m_buffer.size() < ERROR_FRAME_PREFIX.size()) ||
+            m_buffer.startsWith(ERROR_FRAME_PREFIX)) {
+        return;
+    }
+
+    // the first write replaces what an earlier attempt left
+    const QByteArray data = m_buffer.mid(m_written, end - m_written);
+    if (m_outputFilePath.isEmpty()) {
+        m_outputFilePath = job->m_outputPath;
+        outputWriter()->write(m_outputFilePath, data);
+    } else {
+        outputWriter()->append(m_outputFilePath, data);
+    }
+    m_written = end;
+}
+
+void RenderWorker::discardOutputFile()
+{
+    if (!m_outputFilePath.isEmpty()) {
+        outputWriter()->remove(m_outputFilePath);
+        m_outputFilePath.clear();
+    }
+}
+
+void RenderWorker::updateWatchdog()
+{
+    if (m_timeout <= 0 || m_runningJobs.isEmpty()) {
+        m_watchdog->stop();
+        m_watchedJob = 0;
+        return;
+    }
+
+    // PlantUML renders the batch in order, so the clock of a job starts when
+    // the one before it is done
+    RenderJob* job = m_runningJobs.head();
+    if (job != m_watchedJob) {
+        m_watchedJob = job;
+        m_watchedTime.start();
+        m_threadDumpRequested = false;
+        m_watchdog->start(m_timeout);
+    }
+}
+
+QString RenderWorker::timeoutDiagnostics() const
+{
+    QString diagnostics = tr("Rendering timed out after %1 seconds")
+            .arg(m_watchedTime.elapsed() / 1000.0, 0, 'f', 1);
+
+    const QByteArray stderr_tail = m_stderrTail.trimmed();
+    if (!stderr_tail.isEmpty()) {
+        diagnostics += tr("\n\nLast messages of the JVM:\n%1").arg(QString::fromLocal8Bit(stderr_tail));
+    }
+
+    int index = m_buffer.indexOf(THREAD_DUMP_HEADER);
+    if (index >= 0) {
+        QByteArray dump = m_buffer.mid(index, MAX_THREAD_DUMP_SIZE);
+        diagnostics += tr("\n\nThreads of the JVM:\n%1").arg(QString::fromLocal8Bit(dump.trimmed()));
+    }
+    return diagnostics;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,257 @@
+#ifndef RENDERWORKER_H
+#define RENDERWORKER_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QStringList>
+#include <QQueue>
+#include <QProcess>
+#include <QElapsedTimer>
+
+class FileCacheWriter;
+class QTimer;
+class RenderProcess;
+
+//------------------------------------------------------------------------------
+
+struct RenderSettings
+{
+    QString javaPath;
+    QString plantUmlPath;
+    QString graphizPath; // empty to let PlantUML find dot by itself
+    QString workingDirectory;
+    QStringList javaOptions; // put before -jar
+    QStringList environment; // "NAME=value" variables added for PlantUML
+
+    bool operator==(const RenderSettings& other) const;
+    bool operator!=(const RenderSettings& other) const { return !(*this == other); }
+};
+
+//------------------------------------------------------------------------------
+
+// A job only changes state in the worker that owns it, when PlantUML signals
+// something:
+//   Queued   -> Starting  the worker's process is being (re)started for it
+//   Starting -> Running   the process started and the job was written to it
+//   Running  -> Done      all its images were read back
+//   Running  -> Failed    PlantUML reported an error, crashed too often, or
+//                         didn't finish in time
+//   Starting -> Failed    the process can't be started at all
+//   Running/Starting -> Queued  the process died or was stopped, try again
+// Done and Failed jobs are deleted right after jobFinished() is emitted, a
+// queued job is deleted when cancelled.
+//
+// Queued jobs run by priority, then in the order they were queued. Background
+// jobs are only worth doing when nothing the user waits for is left.
+class RenderJob : public QObject
+{
+    Q_OBJECT
+public:
+    enum State { Queued, Starting, Running, Done, Failed };
+    enum Priority { BackgroundPriority, InteractivePriority };
+
+    explicit RenderJob(const QString& key, const QByteArray& document, const QString& format, QObject* parent = 0);
+
+    State state() const { return m_state; }
+    bool isFinished() const { return m_state == Done || m_state == Failed; }
+
+    const QString& key() const { return m_key; }
+    const QByteArray& document() const { return m_document; }
+    const QString& format() const { return m_format; }
+
+    Priority priority() const { return m_priority; }
+    void setPriority(Priority priority) { m_priority = priority; } //< before it's queued
+
+    // When set, the image is also written to this file while it is read (in
+    // the background, by the outputWriter() of the worker), cleared if nothing
+    // was written. The file is removed on failure.
+    const QString& outputPath() const { return m_outputPath; }
+    void setOutputPath(const QString& path) { m_outputPath = path; }
+
+    const QByteArray& output() const { return m_output; }
+    const QString& errorString() const { return m_errorString; }
+    bool hasError() const { return !m_errorString.isEmpty(); }
+    // it failed because it took too long, the error tells what was going on
+    bool timedOut() const { return m_timedOut; }
+
+    int attempts() const { return m_attempts; }
+
+private:
+    friend class AbstractRenderWorker;
+    friend class RenderWorker;
+    friend class HttpRenderWorker;
+    friend class RenderPool;
+
+    State m_state;
+    Priority m_priority;
+    QString m_key;
+    QByteArray m_document;
+    QString m_format;
+    QString m_outputPath;
+    QByteArray m_output;
+    QString m_errorString;
+    bool m_timedOut;
+    int m_attempts;
+    int m_pendingFrames; // still to be read while it's Running
+};
+
+//------------------------------------------------------------------------------
+
+// The queue and the settings shared by the render backends. A job given to
+// render() waits in the queue until control returns to the event loop, so the
+// jobs queued together can be sent to PlantUML together.
+class AbstractRenderWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit AbstractRenderWorker(QObject* parent = 0);
+    virtual ~AbstractRenderWorker();
+
+    const RenderSettings& settings() const { return m_settings; }
+    virtual void setSettings(const RenderSettings& settings);
+
+    // a job whose output grows past this fails, 0 for no limit
+    qint64 maxOutputSize() const { return m_maxOutputSize; }
+    void setMaxOutputSize(qint64 size) { m_maxOutputSize = size; }
+
+    // a job still rendering after this fails, 0 for no limit
+    int timeout() const { return m_timeout; }
+    void setTimeout(int msec) { m_timeout = msec; }
+    // whether the error of a job that timed out shows what the JVM was doing
+    bool capturesThreadDumps() const { return m_captureThreadDumps; }
+    void setCaptureThreadDumps(bool capture) { m_captureThreadDumps = capture; }
+
+    // writes the output files of the jobs, one of its own unless it's given
+    // another one before the first job (the one of the cache, so the files
+    // are complete before they're renamed)
+    FileCacheWriter* outputWriter();
+    void setOutputWriter(FileCacheWriter* writer) { m_outputWriter = writer; }
+
+    virtual bool isBusy() const = 0;
+    // true if a job for this format could start without waiting for a JVM
+    virtual bool isWarmFor(const QString& format) const = 0;
+    int queueSize() const { return m_queue.size(); }
+    int queueSize(RenderJob::Priority priority) const; //< of this priority or higher
+
+    void render(RenderJob* job);
+    // takes the most recently queued job of the highest priority, 0 if none
+    RenderJob* stealJob();
+    // moves a queued job ahead of the lower priority ones, false if it isn't
+    // queued here
+    bool raisePriority(RenderJob* job, RenderJob::Priority priority);
+    bool cancel(RenderJob* job); //< drops a job that hasn't started yet
+    QList<RenderJob*> takeQueuedJobs();
+    // abandons the jobs in flight, they are put back in the queue
+    virtual void stop() = 0;
+
+signals:
+    void jobFinished(RenderJob* job);
+
+protected slots:
+    void dispatch();
+
+protected:
+    virtual void processNext() = 0;
+    // puts a job in the queue after those of the same or a higher priority
+    void enqueue(RenderJob* job);
+    // puts a job whose turn already came back in the queue, before those of
+    // the same or a lower priority
+    void requeue(RenderJob* job);
+
+    RenderSettings m_settings;
+    qint64 m_maxOutputSize;
+    int m_timeout;
+    bool m_captureThreadDumps;
+    QQueue<RenderJob*> m_queue;
+
+private:
+    void scheduleDispatch();
+
+    bool m_dispatchScheduled;
+    FileCacheWriter* m_outputWriter;
+};
+
+//------------------------------------------------------------------------------
+
+// Keeps a PlantUML process running in -pipe mode and feeds it the queued jobs.
+// Every diagram written on stdin is answered on stdout by the image (or by an
+// error message) followed by a delimiter line, so one JVM serves any number of
+// refreshes. The queued jobs are written in batches, and their images are read
+// back in the same order. The process is (re)started on demand, whenever it
+// dies or the requested format or settings change.
+//
+// When it isn't kept running, the process gets its stdin closed after each
+// batch and exits once it's done: the JVM startup is then paid once per batch
+// rather than once per diagram.
+//
+// A watchdog gives each job timeout() milliseconds from the moment PlantUML
+// starts on it. A job that takes longer fails without another attempt (it
+// would just hang again), and the process is killed with whatever it started.
+class RenderWorker : public AbstractRenderWorker
+{
+    Q_OBJECT
+public:
+    explicit RenderWorker(QObject* parent = 0);
+    virtual ~RenderWorker();
+
+    virtual void setSettings(const RenderSettings& settings);
+
+    bool keepRunning() const { return m_keepRunning; }
+    void setKeepRunning(bool keep_running);
+
+    virtual bool isBusy() const { return !m_runningJobs.isEmpty() || !m_queue.isEmpty(); }
+    virtual bool isWarmFor(const QString& format) const { return isRunning() && m_processFormat == format; }
+    bool isRunning() const { return m_process != 0; }
+    const QString& processFormat() const { return m_processFormat; }
+
+    virtual void stop();
+
+private slots:
+    void onProcessStarted();
+    void onProcessReadyReadStandardOutput();
+    void onProcessReadyReadStandardError();
+    void onProcessFinished(int exit_code, QProcess::ExitStatus exit_status);
+    void onProcessError(QProcess::ProcessError error);
+    void onWatchdogTimeout();
+
+private:
+    virtual void processNext();
+    void startProcess(const QString& format);
+    void finishCurrentJob(const QString& error_string);
+    void finishJob(RenderJob* job, const QString& error_string);
+    void processDied(const QString& reason);
+    void requeueRunningJobs();
+    bool checkOutputSize();
+    void writeOutput(int end, bool frame_complete);
+    void discardOutputFile();
+    void updateWatchdog();
+    QString timeoutDiagnostics() const;
+
+    bool m_settingsChanged;
+    bool m_keepRunning;
+
+    RenderProcess* m_process;
+    QString m_processFormat;
+    bool m_processStarted;
+    bool m_inputClosed;
+
+    // the batch written to the process, the head is the job being read
+    QQueue<RenderJob*> m_runningJobs;
+    // the frame being read: searched for the delimiter up to m_scanned, and
+    // queued for m_outputFilePath up to m_written
+    QByteArray m_buffer;
+    int m_scanned;
+    int m_written;
+    QString m_outputFilePath; //< of the job being read, once it's begun
+
+    QTimer* m_watchdog;
+    RenderJob* m_watchedJob; //< the job the watchdog was started for
+    QElapsedTimer m_watchedTime;
+    bool m_threadDumpRequested;
+    QByteArray m_stderrTail; //< the last lines the JVM wrote on stderr
+};
+
+//------------------------------------------------------------------------------
+
+#endif // RENDERWORKER_H
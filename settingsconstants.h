@@ -10,8 +10,10 @@ const QString SETTINGS_WINDOW_STATE = "window_state";
 const QString SETTINGS_SHOW_STATUSBAR = "show_statusbar";
 
 const QString SETTINGS_AUTOREFRESH_ENABLED = "autorefresh_enabled";
-const QString SETTINGS_AUTOREFRESH_TIMEOUT = "autorefresh_timeout";
-const int     SETTINGS_AUTOREFRESH_TIMEOUT_DEFAULT = 5000; // in miliseconds
+const QString SETTINGS_AUTOREFRESH_IDLE_DELAY = "autorefresh_idle_delay";
+const int     SETTINGS_AUTOREFRESH_IDLE_DELAY_DEFAULT = 300; // in miliseconds
+const QString SETTINGS_AUTOREFRESH_MAX_DELAY = "autorefresh_max_delay";
+const int     SETTINGS_AUTOREFRESH_MAX_DELAY_DEFAULT = 2000; // in miliseconds
 
 const QString SETTINGS_AUTOSAVE_IMAGE_ENABLED = "autosave_image_enabled";
 const bool    SETTINGS_AUTOSAVE_IMAGE_ENABLED_DEFAULT = false;
@@ -40,6 +42,39 @@ const QString SETTINGS_CUSTOM_CACHE_PATH = "custom_cache";
 const QString SETTINGS_CACHE_MAX_SIZE = "cache_max_size";
 const int     SETTINGS_CACHE_MAX_SIZE_DEFAULT = 50 * 1024 * 1024; // in bytes
 
+const QString SETTINGS_RENDER_BACKEND = "render_backend";
+const int     SETTINGS_RENDER_BACKEND_DEFAULT = 0; // RenderPool::PipeBackend
+const QString SETTINGS_RENDER_SERVER_PORT = "render_server_port";
+const int     SETTINGS_RENDER_SERVER_PORT_DEFAULT = 0; // any free port
+const QString SETTINGS_RENDER_WORKERS = "render_workers";
+const int     SETTINGS_RENDER_WORKERS_DEFAULT = 0; // one per core
+const QString SETTINGS_KEEP_RENDER_WORKERS_RUNNING = "keep_render_workers_running";
+const bool    SETTINGS_KEEP_RENDER_WORKERS_RUNNING_DEFAULT = true;
+const QString SETTINGS_TUNE_JVM = "tune_jvm";
+const bool    SETTINGS_TUNE_JVM_DEFAULT = true;
+const QString SETTINGS_MAX_IMAGE_SIZE = "max_image_size";
+const int     SETTINGS_MAX_IMAGE_SIZE_DEFAULT = 100 * 1024 * 1024; // in bytes, 0 for no limit
+const QString SETTINGS_RENDER_TIMEOUT = "render_timeout";
+const int     SETTINGS_RENDER_TIMEOUT_DEFAULT = 60; // in seconds, 0 for no limit
+const QString SETTINGS_RENDER_THREAD_DUMPS = "render_thread_dumps";
+const bool    SETTINGS_RENDER_THREAD_DUMPS_DEFAULT = false;
+const QString SETTINGS_DERIVE_PNG = "derive_png";
+const bool    SETTINGS_DERIVE_PNG_DEFAULT = true;
+const QString SETTINGS_PNG_DPI = "png_dpi";
+const int     SETTINGS_PNG_DPI_DEFAULT = 96;
+const QString SETTINGS_PREPARE_OTHER_FORMAT = "prepare_other_format";
+const bool    SETTINGS_PREPARE_OTHER_FORMAT_DEFAULT = false;
+const QString SETTINGS_DRAFT_PREVIEW = "draft_preview";
+const bool    SETTINGS_DRAFT_PREVIEW_DEFAULT = true;
+const QString SETTINGS_MEMOIZE_DOT = "memoize_dot";
+const bool    SETTINGS_MEMOIZE_DOT_DEFAULT = false;
+const QString SETTINGS_LAYOUT_ENGINE = "layout_engine";
+const int     SETTINGS_LAYOUT_ENGINE_DEFAULT = 0; // automatic, 1 for Graphviz, 2 for Smetana
+// the engines measured for each kind of diagram, as "kind=engine", and the
+// java, plantuml.jar and dot they were measured with
+const QString SETTINGS_LAYOUT_CHOICES = "layout_choices";
+const QString SETTINGS_LAYOUT_CHOICES_SETUP = "layout_choices_setup";
+
 const QString SETTINGS_RECENT_DOCUMENTS_SECTION = "RecentDocuments";
 
 const QString SETTINGS_PREFERENCES_SECTION = "Preferences";
@@ -59,8 +94,6 @@ const bool    SETTINGS_EDITOR_REFRESH_ON_SAVE_DEFAULT = false;
 const QString SETTINGS_EDITOR_LAST_DIR = "last_work_dir";
 const QString SETTINGS_EDITOR_LAST_DIR_DEFAULT = "";
 
-const int TIMEOUT_SCALE = 1000;
-
 #if defined(Q_WS_WIN)
 const QString SETTINGS_CUSTOM_JAVA_PATH_DEFAULT = "C:/Program Files (x86)/Java/jre7/bin/java.exe";
 const QString SETTINGS_CUSTOM_PLANTUML_PATH_DEFAULT = "C:/plantuml.jar";
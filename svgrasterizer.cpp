@@ -0,0 +1,85 @@
+#include "svgrasterizer.h"
+#include <QThread>
+#include <QSvgRenderer>
+#include <QImage>
+#include <QPainter>
+#include <QBuffer>
+
+//------------------------------------------------------------------------------
+
+namespace {
+// the resolution of the SVG images of PlantUML
+const int SVG_DPI = 96;
+const qreal INCHES_PER_METER = 39.37;
+// larger images would take hundreds of megabytes
+const qint64 MAX_PIXEL_COUNT = 64 * 1024 * 1024;
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+void SvgRasterizerWorker::rasterize(const QString &key, const QByteArray &svg, int dpi)
+{
+    emit rasterized(key, SvgRasterizer::toPng(svg, dpi));
+}
+
+//------------------------------------------------------------------------------
+
+SvgRasterizer::SvgRasterizer(QObject *parent)
+    : QObject(parent)
+    , m_dpi(SVG_DPI)
+{
+    m_thread = new QThread(this);
+    m_worker = new SvgRasterizerWorker;
+    m_worker->moveToThread(m_thread);
+    connect(m_worker, SIGNAL(rasterized(QString,QByteArray)), this, SIGNAL(finished(QString,QByteArray)));
+    m_thread->start();
+}
+
+SvgRasterizer::~SvgRasterizer()
+{
+    m_thread->quit();
+    m_thread->wait();
+    delete m_worker;
+}
+
+void SvgRasterizer::rasterize(const QString &key, const QByteArray &svg)
+{
+    QMetaObject::invokeMethod(m_worker, "rasterize", Qt::QueuedConnection,
+                              Q_ARG(QString, key), Q_ARG(QByteArray, svg), Q_ARG(int, m_dpi));
+}
+
+QByteArray SvgRasterizer::toPng(const QByteArray &svg, int dpi)
+{
+    QSvgRenderer renderer(svg);
+    if (!renderer.isValid()) {
+        return QByteArray();
+    }
+
+    const QSize size = renderer.defaultSize() * (qreal(dpi) / SVG_DPI);
+    if (size.isEmpty() || qint64(size.width()) * size.height() > MAX_PIXEL_COUNT) {
+        return QByteArray();
+    }
+
+    // like the PNG images of PlantUML, on a white background
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::white);
+    image.setDotsPerMeterX(qRound(dpi * INCHES_PER_METER));
+    image.setDotsPerMeterY(qRound(dpi * INCHES_PER_METER));
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setRenderHint(QPainter::TextAntialiasing);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    renderer.render(&painter);
+    painter.end();
+
+    QByteArray png;
+    QBuffer buffer(&png);
+    buffer.open(QIODevice::WriteOnly);
+    if (!image.save(&buffer, "PNG")) {
+        return QByteArray();
+    }
+    return png;
+}
+
+//------------------------------------------------------------------------------
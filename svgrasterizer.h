@@ -0,0 +1,56 @@
+#ifndef SVGRASTERIZER_H
+#define SVGRASTERIZER_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+
+class QThread;
+
+//------------------------------------------------------------------------------
+
+// Lives in the thread of an SvgRasterizer.
+class SvgRasterizerWorker : public QObject
+{
+    Q_OBJECT
+public slots:
+    void rasterize(const QString& key, const QByteArray& svg, int dpi);
+
+signals:
+    void rasterized(const QString& key, const QByteArray& png);
+};
+
+//------------------------------------------------------------------------------
+
+// Makes PNG images out of the SVG ones PlantUML renders, so that both formats
+// cost a single render. The conversion runs in a thread of its own, large
+// diagrams don't freeze the editor. PlantUML draws its SVG images at 96 dots
+// per inch, the size of its own PNG images: a higher dpi() makes them larger.
+class SvgRasterizer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SvgRasterizer(QObject* parent = 0);
+    virtual ~SvgRasterizer();
+
+    int dpi() const { return m_dpi; }
+    void setDpi(int dpi) { m_dpi = dpi; }
+
+    // finished() gives the PNG image for the key
+    void rasterize(const QString& key, const QByteArray& svg);
+
+    // empty if the SVG image can't be read, or is too large
+    static QByteArray toPng(const QByteArray& svg, int dpi);
+
+signals:
+    void finished(const QString& key, const QByteArray& png);
+
+private:
+    int m_dpi;
+    QThread* m_thread;
+    SvgRasterizerWorker* m_worker;
+};
+
+//------------------------------------------------------------------------------
+
+#endif // SVGRASTERIZER_H
@@ -0,0 +1,76 @@
+#include "diagramsource.h"
+#include <gmock/gmock.h>
+
+TEST(DiagramSource, testEmptyDocumentHasNoDiagrams) {
+    EXPECT_EQ(0, splitDiagrams("").size());
+    EXPECT_EQ(0, splitDiagrams("\n  \n").size());
+}
+
+TEST(DiagramSource, testOneDiagram) {
+    QList<QByteArray> diagrams = splitDiagrams("@startuml\nclass Foo\n@enduml");
+    ASSERT_EQ(1, diagrams.size());
+    EXPECT_EQ(QByteArray("@startuml\nclass Foo\n@enduml\n"), diagrams[0]);
+}
+
+TEST(DiagramSource, testSeveralDiagrams) {
+    QList<QByteArray> diagrams = splitDiagrams("@startuml\nclass Foo\n@enduml\n"
+                                               "\n"
+                                               "@startmindmap\n* Bar\n@endmindmap\n");
+    ASSERT_EQ(2, diagrams.size());
+    EXPECT_EQ(QByteArray("@startuml\nclass Foo\n@enduml\n"), diagrams[0]);
+    EXPECT_EQ(QByteArray("@startmindmap\n* Bar\n@endmindmap\n"), diagrams[1]);
+}
+
+TEST(DiagramSource, testTextBetweenDiagramsIsDropped) {
+    QList<QByteArray> diagrams = splitDiagrams("' comment\n@startuml\nclass Foo\n@enduml\n");
+    ASSERT_EQ(1, diagrams.size());
+    EXPECT_EQ(QByteArray("@startuml\nclass Foo\n@enduml\n"), diagrams[0]);
+}
+
+TEST(DiagramSource, testUnterminatedDiagramIsClosed) {
+    QList<QByteArray> diagrams = splitDiagrams("@startuml\nclass Foo\n");
+    ASSERT_EQ(1, diagrams.size());
+    EXPECT_EQ(QByteArray("@startuml\nclass Foo\n\n@enduml\n"), diagrams[0]);
+}
+
+TEST(DiagramSource, testIndentedEndTagIsMovedToLineStart) {
+    QList<QByteArray> diagrams = splitDiagrams("@startuml\nclass Foo\n  @enduml\n");
+    ASSERT_EQ(1, diagrams.size());
+    EXPECT_EQ(QByteArray("@startuml\nclass Foo\n@enduml\n"), diagrams[0]);
+}
+
+TEST(DiagramSource, testDraftUsesSmetanaLayout) {
+    EXPECT_EQ(QByteArray("@startuml\n!pragma layout smetana\nclass Foo\n@enduml\n"),
+              draftDiagram("@startuml\nclass Foo\n@enduml\n"));
+}
+
+TEST(DiagramSource, testNoDraftWithoutGraphviz) {
+    EXPECT_TRUE(draftDiagram("@startmindmap\n* Bar\n@endmindmap\n").isEmpty());
+    EXPECT_TRUE(draftDiagram("@startuml\n!pragma layout elk\nclass Foo\n@enduml\n").isEmpty());
+}
+
+TEST(DiagramSource, testKindOfUmlDiagrams) {
+    EXPECT_EQ(QByteArray("class"), diagramKind("@startuml\nFoo <|-- Bar\n@enduml\n"));
+    EXPECT_EQ(QByteArray("class"), diagramKind("@startuml\nclass Foo\n@enduml\n"));
+    EXPECT_EQ(QByteArray("usecase"), diagramKind("@startuml\nUser -> (Start)\n@enduml\n"));
+    EXPECT_EQ(QByteArray("state"), diagramKind("@startuml\n[*] --> Idle\n@enduml\n"));
+    EXPECT_EQ(QByteArray("activity"), diagramKind("@startuml\nstart\n:Foo;\nstop\n@enduml\n"));
+    EXPECT_EQ(QByteArray("sequence"), diagramKind("@startuml\nAlice -> Bob: hello\n@enduml\n"));
+    EXPECT_EQ(QByteArray("uml"), diagramKind("@startuml\n@enduml\n"));
+}
+
+TEST(DiagramSource, testKindOfOtherDiagramsIsTheirStartTag) {
+    EXPECT_EQ(QByteArray("mindmap"), diagramKind("@startmindmap\n* Bar\n@endmindmap\n"));
+    EXPECT_EQ(QByteArray("gantt"), diagramKind("@startgantt foo\n@endgantt\n"));
+}
+
+TEST(DiagramSource, testKindOfSingleLines) {
+    bool has_arrows = false;
+    EXPECT_EQ(QByteArray("class"), lineKind("class Foo", has_arrows));
+    EXPECT_EQ(QByteArray(), lineKind("@startuml", has_arrows));
+    EXPECT_EQ(QByteArray(), lineKind("' class Foo", has_arrows));
+    EXPECT_FALSE(has_arrows);
+    EXPECT_EQ(QByteArray(), lineKind("Alice -> Bob", has_arrows));
+    EXPECT_TRUE(has_arrows);
+    EXPECT_EQ(QByteArray("sequence"), defaultDiagramKind(has_arrows));
+}
@@ -0,0 +1,115 @@
+#include "documentdigest.h"
+#include "diagramsource.h"
+#include <gmock/gmock.h>
+
+//------------------------------------------------------------------------------
+
+namespace {
+QList<QByteArray> linesOf(const QByteArray& text)
+{
+    return text.split('\n');
+}
+
+QList<QByteArray> textsOf(DocumentLines& lines)
+{
+    QList<QByteArray> texts;
+    foreach (const DocumentLines::Diagram& diagram, lines.diagrams()) {
+        texts << lines.text(diagram);
+    }
+    return texts;
+}
+
+QList<QByteArray> digestsOf(DocumentLines& lines)
+{
+    QList<QByteArray> digests;
+    foreach (const DocumentLines::Diagram& diagram, lines.diagrams()) {
+        digests << diagram.digest;
+    }
+    return digests;
+}
+
+const QByteArray DOCUMENT =
+        "title\n"
+        "@startuml\n"
+        "class Foo\n"
+        "  @enduml  \n"
+        "\n"
+        "@startuml\n"
+        "!include style.iuml\n"
+        "Alice -> Bob\n"
+        "@enduml\n"
+        "@startmindmap\n"
+        "* Bar";
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+TEST(DocumentLines, testDiagramsAreSplitLikeTheDocument) {
+    DocumentLines lines;
+    lines.replace(0, 0, linesOf(DOCUMENT));
+    EXPECT_EQ(11, lines.size());
+    EXPECT_EQ(splitDiagrams(DOCUMENT), textsOf(lines));
+
+    const QList<DocumentLines::Diagram> diagrams = lines.diagrams();
+    ASSERT_EQ(3, diagrams.size());
+    EXPECT_EQ(QByteArray("class"), diagrams[0].kind);
+    EXPECT_FALSE(diagrams[0].hasIncludes);
+    EXPECT_EQ(QByteArray("sequence"), diagrams[1].kind);
+    EXPECT_TRUE(diagrams[1].hasIncludes);
+    EXPECT_EQ(QByteArray("mindmap"), diagrams[2].kind);
+    EXPECT_FALSE(diagrams[2].closed);
+}
+
+TEST(DocumentLines, testBlankDocument) {
+    DocumentLines lines;
+    EXPECT_TRUE(lines.isBlank());
+    lines.replace(0, 0, linesOf("  \n\n"));
+    EXPECT_TRUE(lines.isBlank());
+    EXPECT_TRUE(lines.diagrams().isEmpty());
+    lines.replace(1, 1, linesOf("foo"));
+    EXPECT_FALSE(lines.isBlank());
+}
+
+TEST(DocumentLines, testOnlyTheEditedDiagramChanges) {
+    DocumentLines lines;
+    lines.replace(0, 0, linesOf(DOCUMENT));
+    const QList<QByteArray> digests = digestsOf(lines);
+
+    lines.replace(7, 1, linesOf("Alice -> Carol"));
+    QList<QByteArray> edited = digestsOf(lines);
+    ASSERT_EQ(3, edited.size());
+    EXPECT_EQ(digests[0], edited[0]);
+    EXPECT_NE(digests[1], edited[1]);
+    EXPECT_EQ(digests[2], edited[2]);
+
+    lines.replace(7, 1, linesOf("Alice -> Bob"));
+    EXPECT_EQ(digests, digestsOf(lines));
+}
+
+TEST(DocumentLines, testEditedLinesAreKeptLikeReadAgain) {
+    QList<QByteArray> text = linesOf(DOCUMENT);
+    DocumentLines edited;
+    edited.replace(0, 0, text);
+
+    // lines removed, replaced and added, here and there
+    const int edits[][3] = { { 0, 1, 0 }, { 3, 0, 2 }, { 5, 2, 1 }, { 9, 1, 3 }, { 1, 3, 3 }, { 0, 0, 1 } };
+    for (unsigned int i = 0; i < sizeof(edits) / sizeof(edits[0]); ++i) {
+        QList<QByteArray> added;
+        for (int j = 0; j < edits[i][2]; ++j) {
+            added << (j % 2 ? "@enduml" : QByteArray("line %1").replace("%1", QByteArray::number(i)));
+        }
+        edited.replace(edits[i][0], edits[i][1], added);
+        for (int j = 0; j < edits[i][1]; ++j) {
+            text.removeAt(edits[i][0]);
+        }
+        for (int j = 0; j < added.size(); ++j) {
+            text.insert(edits[i][0] + j, added[j]);
+        }
+
+        DocumentLines read;
+        read.replace(0, 0, text);
+        EXPECT_EQ(read.size(), edited.size());
+        EXPECT_EQ(digestsOf(read), digestsOf(edited));
+        EXPECT_EQ(textsOf(read), textsOf(edited));
+    }
+}
@@ -0,0 +1,82 @@
+#include "documenthash.h"
+#include <QElapsedTimer>
+#include <QScopedPointer>
+#include <gmock/gmock.h>
+#include <iostream>
+
+//------------------------------------------------------------------------------
+
+namespace {
+const QByteArray HELLO = "hello";
+const QByteArray FOX = "The quick brown fox jumps over the lazy dog";
+// a document of a few hundred KB, as in the slow keystrokes
+const int LARGE_DOCUMENT_SIZE = 512 * 1024;
+const int BENCHMARK_ROUNDS = 100;
+
+QByteArray hashOf(DocumentHash& hash, const QByteArray& data)
+{
+    hash.reset();
+    hash.addData(data);
+    return hash.result();
+}
+
+QByteArray largeDocument()
+{
+    QByteArray document = "@startuml\n";
+    for (int i = 0; document.size() < LARGE_DOCUMENT_SIZE; ++i) {
+        document += QString("class Foo%1 {\n  +bar%1()\n}\nFoo%1 --> Foo%2\n").arg(i).arg(i + 1).toUtf8();
+    }
+    return document + "@enduml\n";
+}
+
+qint64 hashingTime(DocumentHash& hash, const QByteArray& document)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < BENCHMARK_ROUNDS; ++i) {
+        hashOf(hash, document);
+    }
+    return timer.elapsed();
+}
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+TEST(DocumentHash, testFastHashMatchesTheReference) {
+    FastDocumentHash hash;
+    EXPECT_EQ(QByteArray(16, '\0'), hashOf(hash, QByteArray()));
+    EXPECT_EQ(QByteArray("029bbd41b3a7d8cb191dae486a901e5b"), hashOf(hash, HELLO).toHex());
+    EXPECT_EQ(QByteArray("6c1b07bc7bbc4be347939ac4a93c437a"), hashOf(hash, FOX).toHex());
+}
+
+TEST(DocumentHash, testDataMayBeAddedInPieces) {
+    FastDocumentHash hash;
+    const QByteArray whole = hashOf(hash, FOX);
+    hash.reset();
+    for (int i = 0; i < FOX.size(); i += 3) {
+        hash.addData(FOX.mid(i, 3));
+    }
+    EXPECT_EQ(whole, hash.result());
+}
+
+TEST(DocumentHash, testHashesAreCreatedByName) {
+    QScopedPointer<DocumentHash> fast(DocumentHash::create());
+    QScopedPointer<DocumentHash> md5(DocumentHash::create("md5"));
+    ASSERT_FALSE(md5.isNull());
+    EXPECT_NE(fast->name(), md5->name());
+    EXPECT_EQ(QByteArray("5d41402abc4b2a76b9719d911017c592"), hashOf(*md5, HELLO).toHex());
+    EXPECT_TRUE(DocumentHash::create("foo") == 0);
+}
+
+// Compares the two, run with --gtest_also_run_disabled_tests.
+TEST(DocumentHash, DISABLED_benchmarkLargeDocument) {
+    const QByteArray document = largeDocument();
+    Md5DocumentHash md5;
+    FastDocumentHash fast;
+    const qint64 md5_time = hashingTime(md5, document);
+    const qint64 fast_time = hashingTime(fast, document);
+    std::cout << BENCHMARK_ROUNDS << " x " << document.size() << " bytes: "
+              << md5.name().constData() << " " << md5_time << " ms, "
+              << fast.name().constData() << " " << fast_time << " ms" << std::endl;
+    EXPECT_LT(fast_time, md5_time);
+}
@@ -0,0 +1,109 @@
+#include "dotmemo.h"
+#include <QDir>
+#include <QFile>
+#include <gmock/gmock.h>
+
+//------------------------------------------------------------------------------
+
+namespace {
+const QByteArray GRAPH = "digraph { a -> b }";
+const QByteArray LAYOUT = "<svg>a b</svg>";
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+class DotMemoTest : public ::testing::Test
+{
+protected:
+    DotMemoTest()
+        : dir(QDir::temp().absoluteFilePath("plantumlqeditor-dotmemotest"))
+        , memo(dir.path())
+    {
+        QDir().mkpath(dir.path());
+        arguments << "-Tsvg";
+    }
+
+    ~DotMemoTest()
+    {
+        foreach (const QString& name, dir.entryList(QDir::Files)) {
+            dir.remove(name);
+        }
+        QDir::temp().rmdir(dir.path());
+    }
+
+    QDir dir;
+    DotMemo memo;
+    QStringList arguments;
+};
+
+//------------------------------------------------------------------------------
+
+TEST_F(DotMemoTest, testKeyDependsOnEverythingDotIsGiven) {
+    const QString key = memo.key("dot", arguments, GRAPH);
+    EXPECT_EQ(key, memo.key("dot", arguments, GRAPH));
+    EXPECT_NE(key, memo.key("dot", arguments, "digraph { a -> c }"));
+    EXPECT_NE(key, memo.key("dot", QStringList() << "-Tpng", GRAPH));
+    EXPECT_NE(key, memo.key("/opt/graphviz/bin/dot", arguments, GRAPH));
+}
+
+TEST_F(DotMemoTest, testStoredLayoutIsFound) {
+    const QString key = memo.key("dot", arguments, GRAPH);
+    QByteArray output;
+    EXPECT_FALSE(memo.find(key, output));
+
+    memo.store(key, LAYOUT);
+    ASSERT_TRUE(memo.find(key, output));
+    EXPECT_EQ(LAYOUT, output);
+}
+
+TEST_F(DotMemoTest, testHitsAndMissesAreCounted) {
+    memo.countMiss();
+    memo.countHit();
+    memo.countHit();
+    EXPECT_EQ(2, memo.hits());
+    EXPECT_EQ(1, memo.misses());
+
+    memo.resetCounts();
+    EXPECT_EQ(0, memo.hits());
+    EXPECT_EQ(0, memo.misses());
+}
+
+TEST_F(DotMemoTest, testPruneKeepsTheSizeLimit) {
+    memo.store("foo", LAYOUT);
+    memo.store("bar", LAYOUT);
+    memo.prune(LAYOUT.size(), QDateTime::currentDateTime().addSecs(1));
+
+    QByteArray output;
+    EXPECT_EQ(1, int(memo.find("foo", output)) + int(memo.find("bar", output)));
+}
+
+TEST_F(DotMemoTest, testPruneKeepsTheLayoutsStoredSince) {
+    memo.store("foo", LAYOUT);
+    memo.store("bar", LAYOUT);
+    memo.prune(0, QDateTime::currentDateTime().addSecs(-60));
+
+    QByteArray output;
+    EXPECT_TRUE(memo.find("foo", output));
+    EXPECT_TRUE(memo.find("bar", output));
+}
+
+TEST_F(DotMemoTest, testSessionsAreCountedApart) {
+    DotMemo first(dir.path(), "1");
+    DotMemo second(dir.path(), "2");
+    first.countHit();
+    second.countHit();
+    second.countMiss();
+
+    first.resetCounts();
+    EXPECT_EQ(0, first.hits());
+    EXPECT_EQ(1, second.hits());
+    EXPECT_EQ(1, second.misses());
+}
+
+TEST_F(DotMemoTest, testShimEnvironmentNamesDotTheMemoAndTheSession) {
+    const QStringList environment = DotMemo::shimEnvironment("/usr/bin/dot", dir.path(), "1234");
+    EXPECT_EQ(3, environment.size());
+    EXPECT_TRUE(environment.join("\n").contains("/usr/bin/dot"));
+    EXPECT_TRUE(environment.join("\n").contains(dir.path()));
+    EXPECT_TRUE(environment.join("\n").contains("1234"));
+}
@@ -0,0 +1,51 @@
+// Stands in for "java -jar plantuml.jar ... -pipe" in the render worker tests.
+// Every diagram read on stdin is answered by a fake image (the requested
+// format on a line, followed by the diagram itself), then by the delimiter.
+// A diagram containing "error" is answered by an error message instead, and
+// one containing "crash" makes it exit with code 3 without answering, and
+// one containing "hang" makes it say so on stderr and never answer.
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+
+int main(int argc, char** argv)
+{
+    std::string format;
+    std::string delimiter;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-pipedelimitor" && i + 1 < argc) {
+            delimiter = argv[++i];
+        } else if (arg.compare(0, 2, "-t") == 0) {
+            format = arg.substr(2);
+        }
+    }
+
+    std::string line;
+    std::string diagram;
+    while (std::getline(std::cin, line)) {
+        diagram += line + "\n";
+        if (line.compare(0, 4, "@end") != 0) {
+            continue;
+        }
+
+        if (diagram.find("crash") != std::string::npos) {
+            return 3;
+        }
+        if (diagram.find("hang") != std::string::npos) {
+            std::cerr << "hanging on purpose" << std::endl;
+            for (;;) {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+        }
+        if (diagram.find("error") != std::string::npos) {
+            std::cout << "ERROR\n1\nSyntax Error?\n";
+        } else {
+            std::cout << format << "\n" << diagram;
+        }
+        std::cout << delimiter << "\n" << std::flush;
+        diagram.clear();
+    }
+    return 0;
+}
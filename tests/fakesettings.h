@@ -0,0 +1,20 @@
+#ifndef FAKESETTINGS_H
+#define FAKESETTINGS_H
+
+#include "renderworker.h"
+#include "config.h"
+
+//------------------------------------------------------------------------------
+
+// Runs the fake built with the tests instead of java + plantuml.
+inline RenderSettings fakeSettings()
+{
+    RenderSettings settings;
+    settings.javaPath = FAKE_PLANTUML;
+    settings.plantUmlPath = "plantuml.jar"; // ignored by the fake
+    return settings;
+}
+
+//------------------------------------------------------------------------------
+
+#endif // FAKESETTINGS_H
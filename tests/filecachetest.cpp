@@ -16,6 +16,34 @@ public:
     MOCK_CONST_METHOD1(removeFileFromDisk, void(const QString&));
 };
 
+// Counts its removals instead of mocking them, for caches of many items.
+class CountingFileCacheItem : public AbstractFileCacheItem
+{
+public:
+    explicit CountingFileCacheItem(const QString& key, int cost, const QDateTime& date_time)
+        : AbstractFileCacheItem("", key, cost, date_time) {}
+
+    static int removedCount;
+
+private:
+    virtual void removeFileFromDisk(const QString&) const { ++removedCount; }
+};
+
+int CountingFileCacheItem::removedCount = 0;
+
+namespace {
+const int MANY_ITEMS = 100000;
+const QDateTime START_DATE_TIME(QDate(2010, 1, 1), QTime(0, 0));
+
+// for the caches really written to disk
+const QString TEMP_CACHE_PATH = QDir::temp().absoluteFilePath("plantumlqeditor-filecachetest");
+
+AbstractFileCacheItem* newFileCacheItem(const QString& path, const QString& key, int cost, const QDateTime& date_time, QObject* parent)
+{
+    return new FileCacheItem(path, key, cost, date_time, parent);
+}
+} // namespace {}
+
 //------------------------------------------------------------------------------
 
 TEST(FileCache, testMaxCost) {
@@ -212,3 +240,275 @@ TEST(FileCache, testSetPath) {
     EXPECT_EQ(QFileInfo(QDir(TEST_DIR1), "item1.svg").absoluteFilePath(),
               cache.item("item1.svg")->path());
 }
+
+TEST(FileCache, testPartialItemIsAddedOnceComplete) {
+    FileCache cache(100);
+    ASSERT_TRUE(cache.setPath(TEMP_CACHE_PATH, newFileCacheItem));
+
+    QString partial_path = cache.partialItemPath("foo");
+    EXPECT_NE(partial_path, cache.partialItemPath("foo"));
+
+    // as a render worker streams it
+    cache.writer()->write(partial_path, "123");
+    cache.writer()->append(partial_path, "45");
+    EXPECT_FALSE(cache.hasItem("foo"));
+
+    cache.addPartialItem(partial_path, "foo", "12345", newFileCacheItem);
+    EXPECT_TRUE(cache.hasItem("foo"));
+    EXPECT_EQ(5, cache.totalCost());
+    EXPECT_EQ(QByteArray("12345"), cache.itemData("foo"));
+    cache.flush();
+    EXPECT_FALSE(QFile::exists(partial_path));
+    QFile file(cache.item("foo")->path());
+    ASSERT_TRUE(file.open(QIODevice::ReadOnly));
+    EXPECT_EQ(QByteArray("12345"), file.readAll());
+    file.close();
+
+    cache.clearFromDisk();
+}
+
+TEST(FileCache, testPartialItemsLeftBehindAreRemoved) {
+    QString partial_path;
+    {
+        FileCache cache(100);
+        ASSERT_TRUE(cache.setPath(TEMP_CACHE_PATH, newFileCacheItem));
+        partial_path = cache.partialItemPath("foo");
+        QFile file(partial_path);
+        ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+        file.write("12345");
+    }
+
+    FileCache cache(100);
+    ASSERT_TRUE(cache.setPath(TEMP_CACHE_PATH, newFileCacheItem));
+    EXPECT_EQ(0, cache.size());
+    EXPECT_FALSE(QFile::exists(partial_path));
+}
+
+TEST(FileCache, testItemsAreWrittenInTheBackground) {
+    QString item_path;
+    {
+        FileCache cache(100);
+        ASSERT_TRUE(cache.setPath(TEMP_CACHE_PATH, newFileCacheItem));
+        cache.addItem("12345", "foo", newFileCacheItem);
+        EXPECT_TRUE(cache.hasItem("foo"));
+        EXPECT_EQ(5, cache.totalCost());
+        EXPECT_EQ(QByteArray("12345"), cache.itemData("foo"));
+        item_path = cache.item("foo")->path();
+    }
+    // written before the cache is gone
+    EXPECT_TRUE(QFile::exists(item_path));
+
+    FileCache cache(100);
+    ASSERT_TRUE(cache.setPath(TEMP_CACHE_PATH, newFileCacheItem));
+    EXPECT_EQ(QByteArray("12345"), cache.itemData("foo"));
+    cache.clearFromDisk();
+    cache.flush();
+    EXPECT_FALSE(QFile::exists(item_path));
+}
+
+TEST(FileCache, testItemWhichCannotBeWrittenIsDropped) {
+    FileCache cache(100);
+    ASSERT_TRUE(cache.setPath(TEMP_CACHE_PATH, newFileCacheItem));
+    cache.addItem("12345", "no-such-dir/foo", newFileCacheItem);
+    EXPECT_TRUE(cache.hasItem("no-such-dir/foo"));
+    cache.flush();
+    EXPECT_FALSE(cache.hasItem("no-such-dir/foo"));
+    EXPECT_EQ(0, cache.totalCost());
+}
+
+TEST(FileCache, testItemEvictedRightAwayIsNotWritten) {
+    FileCache cache(10);
+    ASSERT_TRUE(cache.setPath(TEMP_CACHE_PATH, newFileCacheItem));
+    // newer than anything added now, it keeps the cache full
+    const QDateTime tomorrow = QDateTime::currentDateTime().addDays(1);
+    cache.addItem(newFileCacheItem(TEMP_CACHE_PATH, "bar", 10, tomorrow, 0));
+
+    cache.addItem("12345", "foo", newFileCacheItem);
+    EXPECT_FALSE(cache.hasItem("foo"));
+    EXPECT_TRUE(cache.hasItem("bar"));
+    EXPECT_EQ(10, cache.totalCost());
+
+    QString partial_path = cache.partialItemPath("baz");
+    cache.writer()->write(partial_path, "12345");
+    cache.addPartialItem(partial_path, "baz", "12345", newFileCacheItem);
+    EXPECT_FALSE(cache.hasItem("baz"));
+
+    cache.flush();
+    EXPECT_FALSE(QFile::exists(QDir(TEMP_CACHE_PATH).absoluteFilePath("foo")));
+    EXPECT_FALSE(QFile::exists(QDir(TEMP_CACHE_PATH).absoluteFilePath("baz")));
+    EXPECT_FALSE(QFile::exists(partial_path));
+
+    cache.clearFromDisk();
+}
+
+TEST(FileCacheWriter, testAppendingToAMissingFileFails) {
+    const QString path = QDir(TEMP_CACHE_PATH).absoluteFilePath("missing.part");
+    ASSERT_TRUE(QDir().mkpath(TEMP_CACHE_PATH));
+    QFile::remove(path);
+
+    FileCacheWriter writer;
+    const qint64 serial = writer.append(path, "45");
+    writer.flush();
+    qint64 done_serial = 0;
+    EXPECT_EQ(QList<qint64>() << serial, writer.takeProgress(&done_serial));
+    EXPECT_EQ(serial, done_serial);
+    EXPECT_FALSE(QFile::exists(path));
+}
+
+TEST(FileCacheWriter, testFailuresAreNeverAheadOfTheDoneSerial) {
+    const QString path = QDir(TEMP_CACHE_PATH).absoluteFilePath("missing.part");
+    ASSERT_TRUE(QDir().mkpath(TEMP_CACHE_PATH));
+    QFile::remove(path);
+
+    // the progress is taken while the operations keep failing in the thread
+    // of the writer, so some fail between two reads of it
+    FileCacheWriter writer;
+    QList<qint64> serials;
+    for (int i = 0; i < 1000; ++i) {
+        serials << writer.append(path, "45");
+    }
+    QList<qint64> failures;
+    qint64 done_serial = 0;
+    while (done_serial < serials.last()) {
+        const QList<qint64> taken = writer.takeProgress(&done_serial);
+        foreach (qint64 serial, taken) {
+            EXPECT_LE(serial, done_serial);
+        }
+        failures << taken;
+    }
+    EXPECT_EQ(serials, failures);
+}
+
+TEST(FileCache, testItemsFailingWhileOthersAreAddedAreDropped) {
+    FileCache cache(1000000);
+    ASSERT_TRUE(cache.setPath(TEMP_CACHE_PATH, newFileCacheItem));
+    // each addition collects the writes done meanwhile
+    for (int i = 0; i < 200; ++i) {
+        cache.addItem("12345", QString("no-such-dir/%1").arg(i), newFileCacheItem);
+        cache.addItem("12345", QString("item%1").arg(i), newFileCacheItem);
+    }
+    cache.flush();
+    for (int i = 0; i < 200; ++i) {
+        EXPECT_FALSE(cache.hasItem(QString("no-such-dir/%1").arg(i)));
+        EXPECT_EQ(QByteArray("12345"), cache.itemData(QString("item%1").arg(i)));
+    }
+
+    cache.clearFromDisk();
+    cache.flush();
+}
+
+TEST(FileCache, testKeysAreNamespacedByGeneration) {
+    FileCache cache(100);
+    EXPECT_EQ(QString("foo.svg"), cache.keyInGeneration("foo.svg"));
+    EXPECT_FALSE(cache.isStale("foo.svg"));
+
+    cache.setGeneration("abc");
+    EXPECT_EQ(QString("abc-foo.svg"), cache.keyInGeneration("foo.svg"));
+    EXPECT_FALSE(cache.isStale("abc-foo.svg"));
+    EXPECT_TRUE(cache.isStale("xyz-foo.svg"));
+    EXPECT_TRUE(cache.isStale("foo.svg"));
+}
+
+TEST(FileCache, testStaleItemsAreCollectedOldestFirst) {
+    FileCache cache(100);
+    MockFileCacheItem* old_item = new MockFileCacheItem("/foo", "old-item1", 10, QDateTime(QDate(2010, 1, 1), QTime(0, 0)));
+    MockFileCacheItem* older_item = new MockFileCacheItem("/foo", "old-item2", 10, QDateTime(QDate(2009, 1, 1), QTime(0, 0)));
+    MockFileCacheItem* new_item = new MockFileCacheItem("/foo", "new-item1", 10, QDateTime(QDate(2010, 1, 2), QTime(0, 0)));
+    EXPECT_CALL(*older_item, removeFileFromDisk(QString("/foo/old-item2"))).Times(1);
+    EXPECT_CALL(*old_item, removeFileFromDisk(QString("/foo/old-item1"))).Times(1);
+    EXPECT_CALL(*new_item, removeFileFromDisk(_)).Times(0);
+    cache.addItem(old_item);
+    cache.addItem(older_item);
+    cache.addItem(new_item);
+
+    cache.setGeneration("new");
+    EXPECT_EQ(2, cache.staleItemCount());
+    EXPECT_TRUE(cache.collectStaleItems(1));
+    EXPECT_FALSE(cache.hasItem("old-item2"));
+    EXPECT_TRUE(cache.hasItem("old-item1"));
+
+    EXPECT_FALSE(cache.collectStaleItems(1));
+    EXPECT_EQ(0, cache.staleItemCount());
+    EXPECT_TRUE(cache.hasItem("new-item1"));
+    EXPECT_EQ(10, cache.totalCost());
+}
+
+TEST(FileCache, testItemsAddedOutOfOrderAreKeptByDate) {
+    FileCache cache(100);
+    cache.addItem(new CountingFileCacheItem("b", 10, START_DATE_TIME.addSecs(2)));
+    cache.addItem(new CountingFileCacheItem("c", 10, START_DATE_TIME.addSecs(3)));
+    cache.addItem(new CountingFileCacheItem("a", 10, START_DATE_TIME.addSecs(1)));
+    EXPECT_EQ(QString("a"), cache.oldestItem()->key());
+}
+
+TEST(FileCache, testTouchedItemIsRemovedLast) {
+    CountingFileCacheItem::removedCount = 0;
+    FileCache cache(30);
+    cache.addItem(new CountingFileCacheItem("a", 10, START_DATE_TIME.addSecs(1)));
+    cache.addItem(new CountingFileCacheItem("b", 10, START_DATE_TIME.addSecs(2)));
+    cache.addItem(new CountingFileCacheItem("c", 10, START_DATE_TIME.addSecs(3)));
+    cache.touch("a");
+    EXPECT_EQ(QString("b"), cache.oldestItem()->key());
+
+    cache.addItem(new CountingFileCacheItem("d", 10, QDateTime::currentDateTime().addSecs(1)));
+    EXPECT_EQ(1, CountingFileCacheItem::removedCount);
+    EXPECT_FALSE(cache.hasItem("b"));
+    EXPECT_TRUE(cache.hasItem("a"));
+}
+
+TEST(FileCache, testManyItemsAreAdded) {
+    FileCache cache(MANY_ITEMS);
+    for (int i = 0; i < MANY_ITEMS; ++i) {
+        cache.addItem(new CountingFileCacheItem(QString::number(i), 1, START_DATE_TIME.addSecs(i)));
+    }
+    EXPECT_EQ(MANY_ITEMS, cache.size());
+    EXPECT_EQ(MANY_ITEMS, cache.totalCost());
+    EXPECT_EQ(QString("0"), cache.oldestItem()->key());
+}
+
+TEST(FileCache, testManyItemsAreRemovedOldestFirst) {
+    CountingFileCacheItem::removedCount = 0;
+    FileCache cache(MANY_ITEMS / 2);
+    for (int i = 0; i < MANY_ITEMS; ++i) {
+        cache.addItem(new CountingFileCacheItem(QString::number(i), 1, START_DATE_TIME.addSecs(i)));
+    }
+    EXPECT_EQ(MANY_ITEMS / 2, cache.size());
+    EXPECT_EQ(MANY_ITEMS / 2, CountingFileCacheItem::removedCount);
+    EXPECT_EQ(QString::number(MANY_ITEMS / 2), cache.oldestItem()->key());
+
+    for (int i = 0; i < MANY_ITEMS / 2; i += 2) {
+        cache.touch(QString::number(MANY_ITEMS / 2 + i));
+    }
+    EXPECT_EQ(QString::number(MANY_ITEMS / 2 + 1), cache.oldestItem()->key());
+}
+
+TEST(FileCacheKey, testKeysAreSpelledAsTheyWereGiven) {
+    const QString names[] = {
+        "foo",
+        "0123456789abcdef0123456789abcdef.svg",
+        "abc-0123456789abcdef0123456789abcdef.png",
+        "abc-0123456789ABCDEF0123456789ABCDEF.png", // upper case isn't a digest
+        "0123456789abcdef0123456789abcdef0.svg", // too long for a digest
+        "0123456789abcdef",
+    };
+    foreach (const QString& name, names) {
+        EXPECT_EQ(name, FileCacheKey(name).toString());
+    }
+}
+
+TEST(FileCacheKey, testKeysAreEqualWhenTheirNamesAre) {
+    const QString name = "abc-0123456789abcdef0123456789abcdef.svg";
+    EXPECT_EQ(FileCacheKey(name), FileCacheKey(name));
+    EXPECT_EQ(qHash(FileCacheKey(name)), qHash(FileCacheKey(name)));
+    EXPECT_NE(FileCacheKey(name), FileCacheKey("abc-0123456789abcdef0123456789abcdef.png"));
+    EXPECT_NE(FileCacheKey(name), FileCacheKey("xyz-0123456789abcdef0123456789abcdef.svg"));
+    EXPECT_NE(FileCacheKey(name), FileCacheKey("abc-1123456789abcdef0123456789abcdef.svg"));
+}
+
+TEST(FileCacheKey, testPrefixesReachIntoTheDigest) {
+    const FileCacheKey key("abc-0123456789abcdef0123456789abcdef.svg");
+    EXPECT_TRUE(key.startsWith("abc-"));
+    EXPECT_TRUE(key.startsWith("abc-0123"));
+    EXPECT_FALSE(key.startsWith("abc-1"));
+    EXPECT_FALSE(key.startsWith("xyz-"));
+}
@@ -0,0 +1,203 @@
+#include "httprenderworker.h"
+#include "filecache.h"
+#include "picowebserver.h"
+#include "jobrecorder.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QSet>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <gmock/gmock.h>
+
+//------------------------------------------------------------------------------
+
+namespace {
+const QByteArray FOO_DIAGRAM = "@startuml\nclass Foo\n@enduml\n";
+const QByteArray BAR_DIAGRAM = "@startuml\nclass \"Bar\"\n@enduml\n";
+const QByteArray ERROR_DIAGRAM = "@startuml\nerror\n@enduml\n";
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+// Stands in for "java -jar plantuml.jar -picoweb". Every request is answered
+// by its own body as the image, on the same keep-alive connection, or by the
+// error headers when the body contains "error".
+class FakePicoweb : public QTcpServer
+{
+    Q_OBJECT
+public:
+    FakePicoweb()
+        : requestCount(0)
+    {
+        connect(this, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+        listen(QHostAddress::LocalHost, 0);
+    }
+
+    int requestCount;
+
+private slots:
+    void onNewConnection()
+    {
+        while (QTcpSocket* socket = nextPendingConnection()) {
+            connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        }
+    }
+
+    void onReadyRead()
+    {
+        QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+        QByteArray& buffer = m_buffers[socket];
+        buffer += socket->readAll();
+
+        // answers every complete request, they may be pipelined
+        forever {
+            int header_end = buffer.indexOf("\r\n\r\n");
+            if (header_end < 0) {
+                return;
+            }
+            int length = 0;
+            foreach (const QByteArray& line, buffer.left(header_end).split('\n')) {
+                if (line.toLower().startsWith("content-length:")) {
+                    length = line.mid(15).trimmed().toInt();
+                }
+            }
+            if (buffer.size() < header_end + 4 + length) {
+                return;
+            }
+
+            QByteArray body = buffer.mid(header_end + 4, length);
+            buffer.remove(0, header_end + 4 + length);
+            ++requestCount;
+
+            QByteArray reply = "HTTP/1.1 200 OK\r\nContent-Type: image/svg+xml\r\n";
+            if (body.contains("error")) {
+                reply += "X-PlantUML-Diagram-Error: Syntax Error?\r\nX-PlantUML-Diagram-Error-Line: 1\r\n";
+            }
+            reply += "Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n" + body;
+            socket->write(reply);
+        }
+    }
+
+private:
+    QHash<QTcpSocket*, QByteArray> m_buffers;
+};
+
+//------------------------------------------------------------------------------
+
+class HttpRenderWorkerTest : public ::testing::Test
+{
+protected:
+    HttpRenderWorkerTest()
+        : worker(&server)
+        , recorder(&worker)
+    {
+        // the fake already listens there, so it is shared rather than started
+        server.setRequestedPort(fake.serverPort());
+    }
+
+    FakePicoweb fake;
+    PicowebServer server;
+    HttpRenderWorker worker;
+    JobRecorder recorder;
+};
+
+//------------------------------------------------------------------------------
+
+TEST_F(HttpRenderWorkerTest, testJobIsDone) {
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(1));
+
+    EXPECT_EQ(QString("foo"), recorder.jobs[0].key);
+    EXPECT_EQ(RenderJob::Done, recorder.jobs[0].state);
+    EXPECT_EQ(QByteArray("{\"source\":\"@startuml\\nclass Foo\\n@enduml\\n\",\"options\":[\"-tsvg\"]}"),
+              recorder.jobs[0].output);
+    EXPECT_FALSE(worker.isBusy());
+    EXPECT_TRUE(server.isShared());
+    EXPECT_EQ(1, fake.requestCount);
+}
+
+TEST_F(HttpRenderWorkerTest, testSourceIsEscaped) {
+    worker.render(new RenderJob("bar", BAR_DIAGRAM, "png"));
+    ASSERT_TRUE(recorder.waitFor(1));
+
+    EXPECT_EQ(RenderJob::Done, recorder.jobs[0].state);
+    EXPECT_TRUE(recorder.jobs[0].output.contains("class \\\"Bar\\\"\\n"));
+    EXPECT_TRUE(recorder.jobs[0].output.contains("\"-tpng\""));
+}
+
+TEST_F(HttpRenderWorkerTest, testDiagramErrorFailsOnlyItsJob) {
+    worker.render(new RenderJob("error", ERROR_DIAGRAM, "svg"));
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(2));
+
+    foreach (const FinishedJob& job, recorder.jobs) {
+        if (job.key == "error") {
+            EXPECT_EQ(RenderJob::Failed, job.state);
+            EXPECT_EQ(QString("ERROR\n1\nSyntax Error?"), job.errorString);
+            EXPECT_TRUE(job.output.isEmpty());
+        } else {
+            EXPECT_EQ(RenderJob::Done, job.state);
+        }
+    }
+}
+
+TEST_F(HttpRenderWorkerTest, testManyJobsAreDone) {
+    const int COUNT = 20;
+    for (int i = 0; i < COUNT; ++i) {
+        worker.render(new RenderJob(QString::number(i), FOO_DIAGRAM, "svg"));
+    }
+    ASSERT_TRUE(recorder.waitFor(COUNT));
+
+    // the replies may come in any order
+    QSet<QString> keys;
+    foreach (const FinishedJob& job, recorder.jobs) {
+        EXPECT_EQ(RenderJob::Done, job.state);
+        keys << job.key;
+    }
+    EXPECT_EQ(COUNT, keys.size());
+    EXPECT_EQ(COUNT, fake.requestCount);
+}
+
+TEST_F(HttpRenderWorkerTest, testOutputIsWrittenToFile) {
+    const QString path = QDir::temp().absoluteFilePath("httprenderworkertest-output.svg");
+    RenderJob* job = new RenderJob("foo", FOO_DIAGRAM, "svg");
+    job->setOutputPath(path);
+    worker.render(job);
+    ASSERT_TRUE(recorder.waitFor(1));
+    ASSERT_EQ(RenderJob::Done, recorder.jobs[0].state);
+
+    worker.outputWriter()->flush(); // it's written in the background
+    QFile file(path);
+    ASSERT_TRUE(file.open(QIODevice::ReadOnly));
+    EXPECT_EQ(recorder.jobs[0].output, file.readAll());
+    file.remove();
+}
+
+TEST_F(HttpRenderWorkerTest, testOutputLargerThanLimitFails) {
+    worker.setMaxOutputSize(FOO_DIAGRAM.size());
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(1));
+    EXPECT_EQ(RenderJob::Failed, recorder.jobs[0].state);
+    EXPECT_TRUE(recorder.jobs[0].output.isEmpty());
+}
+
+TEST_F(HttpRenderWorkerTest, testServerThatCantStartFailsQueuedJobs) {
+    RenderSettings settings;
+    settings.javaPath = QCoreApplication::applicationDirPath() + "/no-such-java";
+    server.setSettings(settings);
+    server.setRequestedPort(0); // not the fake
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    worker.render(new RenderJob("bar", BAR_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(2));
+
+    EXPECT_EQ(RenderJob::Failed, recorder.jobs[0].state);
+    EXPECT_EQ(RenderJob::Failed, recorder.jobs[1].state);
+    EXPECT_FALSE(worker.isBusy());
+    EXPECT_EQ(PicowebServer::NotRunning, server.state());
+}
+
+//------------------------------------------------------------------------------
+
+#include "httprenderworkertest.moc"
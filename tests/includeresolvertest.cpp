@@ -0,0 +1,109 @@
+#include "includeresolver.h"
+#include <QDir>
+#include <QFile>
+#include <gmock/gmock.h>
+
+//------------------------------------------------------------------------------
+
+namespace {
+const QByteArray DIAGRAM = "@startuml\n!include style.iuml\nclass Foo\n@enduml\n";
+
+void writeFile(const QString& path, const QByteArray& content)
+{
+    QFile file(path);
+    file.open(QIODevice::WriteOnly);
+    file.write(content);
+}
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+class IncludeResolverTest : public ::testing::Test
+{
+protected:
+    IncludeResolverTest()
+        : dir(QDir::temp().absoluteFilePath("plantumlqeditor-includeresolvertest"))
+    {
+        QDir().mkpath(dir.absoluteFilePath("parts"));
+        writeFile(dir.absoluteFilePath("style.iuml"), "skinparam monochrome true\n");
+    }
+
+    ~IncludeResolverTest()
+    {
+        QDir parts_dir(dir.absoluteFilePath("parts"));
+        foreach (const QString& name, parts_dir.entryList(QDir::Files)) {
+            parts_dir.remove(name);
+        }
+        dir.rmdir(parts_dir.path());
+        foreach (const QString& name, dir.entryList(QDir::Files)) {
+            dir.remove(name);
+        }
+        QDir::temp().rmdir(dir.path());
+    }
+
+    QDir dir;
+    IncludeResolver resolver;
+};
+
+//------------------------------------------------------------------------------
+
+TEST_F(IncludeResolverTest, testIncludePathsAsWritten) {
+    const QStringList paths = IncludeResolver::includePaths(
+                "!include a.iuml\n"
+                "  !include_once \"b c.iuml\"\n"
+                "!includesub d.iuml!PART\n"
+                "!include e.iuml!1\n"
+                "!include <C4/C4_Container>\n"
+                "!includeurl http://example.com/f.iuml\n"
+                "!include https://example.com/g.iuml\n"
+                "' !include h.iuml\n");
+    EXPECT_EQ(QStringList() << "a.iuml" << "b c.iuml" << "d.iuml" << "e.iuml", paths);
+}
+
+TEST_F(IncludeResolverTest, testNoHashWithoutIncludes) {
+    EXPECT_TRUE(resolver.dependencyHash("@startuml\nclass Foo\n@enduml\n", dir.path()).isEmpty());
+}
+
+TEST_F(IncludeResolverTest, testHashChangesWithTheIncludedFile) {
+    const QByteArray hash = resolver.dependencyHash(DIAGRAM, dir.path());
+    EXPECT_FALSE(hash.isEmpty());
+    EXPECT_EQ(hash, resolver.dependencyHash(DIAGRAM, dir.path()));
+
+    writeFile(dir.absoluteFilePath("style.iuml"), "skinparam monochrome false\n");
+    EXPECT_NE(hash, resolver.dependencyHash(DIAGRAM, dir.path()));
+}
+
+TEST_F(IncludeResolverTest, testNestedIncludesAreResolvedFromTheirFile) {
+    writeFile(dir.absoluteFilePath("parts/all.iuml"), "!include colors.iuml\n");
+    writeFile(dir.absoluteFilePath("parts/colors.iuml"), "skinparam classBackgroundColor White\n");
+    const QByteArray diagram = "@startuml\n!include parts/all.iuml\n@enduml\n";
+
+    const QStringList dependencies = resolver.dependencies(diagram, dir.path());
+    EXPECT_EQ(QStringList() << dir.absoluteFilePath("parts/all.iuml") << dir.absoluteFilePath("parts/colors.iuml"),
+              dependencies);
+
+    const QByteArray hash = resolver.dependencyHash(diagram, dir.path());
+    writeFile(dir.absoluteFilePath("parts/colors.iuml"), "skinparam classBackgroundColor Black\n");
+    EXPECT_NE(hash, resolver.dependencyHash(diagram, dir.path()));
+}
+
+TEST_F(IncludeResolverTest, testOtherFilesDontChangeTheHash) {
+    const QByteArray hash = resolver.dependencyHash(DIAGRAM, dir.path());
+    writeFile(dir.absoluteFilePath("other.iuml"), "skinparam monochrome false\n");
+    EXPECT_EQ(hash, resolver.dependencyHash(DIAGRAM, dir.path()));
+}
+
+TEST_F(IncludeResolverTest, testMissingFileCountsUntilItShowsUp) {
+    const QByteArray diagram = "@startuml\n!include later.iuml\n@enduml\n";
+    const QByteArray hash = resolver.dependencyHash(diagram, dir.path());
+    EXPECT_FALSE(hash.isEmpty());
+
+    writeFile(dir.absoluteFilePath("later.iuml"), "class Bar\n");
+    EXPECT_NE(hash, resolver.dependencyHash(diagram, dir.path()));
+}
+
+TEST_F(IncludeResolverTest, testIncludeCyclesEnd) {
+    writeFile(dir.absoluteFilePath("a.iuml"), "!include b.iuml\n");
+    writeFile(dir.absoluteFilePath("b.iuml"), "!include a.iuml\n");
+    EXPECT_EQ(2, resolver.dependencies("@startuml\n!include a.iuml\n@enduml\n", dir.path()).size());
+}
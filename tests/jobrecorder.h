@@ -0,0 +1,74 @@
+#ifndef JOBRECORDER_H
+#define JOBRECORDER_H
+
+#include "renderworker.h"
+#include <QObject>
+#include <QEventLoop>
+#include <QTimer>
+
+//------------------------------------------------------------------------------
+
+// What a job looked like when it finished: the job itself is deleted soon after.
+struct FinishedJob
+{
+    RenderJob* job;
+    QString key;
+    RenderJob::State state;
+    QByteArray output;
+    QString errorString;
+    int attempts;
+    bool timedOut;
+};
+
+// Records the jobs finished by a worker or a pool, whatever sends
+// jobFinished(RenderJob*).
+class JobRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    static const int WAIT_TIMEOUT = 10000; // in miliseconds
+
+    explicit JobRecorder(QObject* sender)
+        : m_loop(0)
+        , m_count(0)
+    {
+        connect(sender, SIGNAL(jobFinished(RenderJob*)), this, SLOT(onJobFinished(RenderJob*)));
+    }
+
+    // runs the event loop until count jobs are finished, false on timeout
+    bool waitFor(int count)
+    {
+        if (jobs.size() < count) {
+            QEventLoop loop;
+            QTimer::singleShot(WAIT_TIMEOUT, &loop, SLOT(quit()));
+            m_loop = &loop;
+            m_count = count;
+            loop.exec();
+            m_loop = 0;
+        }
+        return jobs.size() >= count;
+    }
+
+    QList<FinishedJob> jobs;
+
+private slots:
+    void onJobFinished(RenderJob* job)
+    {
+        FinishedJob finished = {
+            job, job->key(), job->state(), job->output(),
+            job->errorString(), job->attempts(), job->timedOut()
+        };
+        jobs << finished;
+        if (m_loop && jobs.size() >= m_count) {
+            m_loop->quit();
+        }
+    }
+
+private:
+    QEventLoop* m_loop;
+    int m_count;
+};
+
+//------------------------------------------------------------------------------
+
+#endif // JOBRECORDER_H
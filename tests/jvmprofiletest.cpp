@@ -0,0 +1,89 @@
+#include "jvmprofile.h"
+#include <QDir>
+#include <QFile>
+#include <gmock/gmock.h>
+
+//------------------------------------------------------------------------------
+
+namespace {
+void writeFile(const QString& path, const QByteArray& content)
+{
+    QFile file(path);
+    file.open(QIODevice::WriteOnly);
+    file.write(content);
+}
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+class JvmProfileTest : public ::testing::Test
+{
+protected:
+    JvmProfileTest()
+        : dir(QDir::temp().absoluteFilePath("plantumlqeditor-jvmprofiletest"))
+    {
+        QDir().mkpath(dir.path());
+        javaPath = dir.absoluteFilePath("java");
+        jarPath = dir.absoluteFilePath("plantuml.jar");
+        writeFile(javaPath, "java");
+        writeFile(jarPath, "plantuml");
+        profile.setPath(dir.absoluteFilePath("jvm"));
+    }
+
+    ~JvmProfileTest()
+    {
+        QDir jvm_dir(profile.path());
+        foreach (const QString& name, jvm_dir.entryList(QDir::Files)) {
+            jvm_dir.remove(name);
+        }
+        dir.rmdir(profile.path());
+        dir.remove(javaPath);
+        dir.remove(jarPath);
+    }
+
+    QDir dir;
+    QString javaPath;
+    QString jarPath;
+    JvmProfile profile;
+};
+
+//------------------------------------------------------------------------------
+
+TEST_F(JvmProfileTest, testNoOptionsWhenDisabled) {
+    profile.setEnabled(false);
+    EXPECT_TRUE(profile.javaOptions(javaPath, jarPath, true).isEmpty());
+}
+
+TEST_F(JvmProfileTest, testShortLivedProcessesSkipTheOptimizingCompiler) {
+    EXPECT_TRUE(profile.javaOptions(javaPath, jarPath, true).contains("-XX:TieredStopAtLevel=1"));
+    EXPECT_FALSE(profile.javaOptions(javaPath, jarPath, false).contains("-XX:TieredStopAtLevel=1"));
+}
+
+TEST_F(JvmProfileTest, testArchiveIsUsedOnceItExists) {
+    const QString archive_path = profile.archivePath(profile.fingerprint(javaPath, jarPath));
+    const QString option = QString("-XX:SharedArchiveFile=%1").arg(archive_path);
+    EXPECT_FALSE(profile.javaOptions(javaPath, jarPath, false).contains(option));
+
+    QDir().mkpath(profile.path());
+    writeFile(archive_path, "archive");
+    EXPECT_TRUE(profile.javaOptions(javaPath, jarPath, false).contains(option));
+}
+
+TEST_F(JvmProfileTest, testFingerprintChangesWithTheJar) {
+    const QString print = profile.fingerprint(javaPath, jarPath);
+    EXPECT_FALSE(print.isEmpty());
+    EXPECT_EQ(print, profile.fingerprint(javaPath, jarPath));
+
+    writeFile(jarPath, "another plantuml");
+    EXPECT_NE(print, profile.fingerprint(javaPath, jarPath));
+}
+
+TEST_F(JvmProfileTest, testNoFingerprintForMissingFiles) {
+    EXPECT_TRUE(profile.fingerprint(dir.absoluteFilePath("no-such-java"), jarPath).isEmpty());
+    EXPECT_TRUE(profile.fingerprint(javaPath, dir.absoluteFilePath("no-such.jar")).isEmpty());
+}
+
+TEST_F(JvmProfileTest, testMissingJavaIsNotTrained) {
+    profile.prepare(dir.absoluteFilePath("no-such-java"), jarPath);
+    EXPECT_FALSE(profile.isTraining());
+}
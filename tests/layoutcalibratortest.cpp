@@ -0,0 +1,65 @@
+#include "layoutcalibrator.h"
+#include "fakesettings.h"
+#include <QEventLoop>
+#include <QTimer>
+#include <gmock/gmock.h>
+
+//------------------------------------------------------------------------------
+
+namespace {
+const int WAIT_TIMEOUT = 10000; // in miliseconds
+
+const QByteArray CLASS_DIAGRAM = "@startuml\nclass Foo\n@enduml\n";
+const QByteArray SEQUENCE_DIAGRAM = "@startuml\nAlice -> Bob: hello\n@enduml\n";
+// the fake answers it with an error, whatever the engine
+const QByteArray FAILING_DIAGRAM = "@startuml\n[*] --> error\n@enduml\n";
+const QByteArray MINDMAP_DIAGRAM = "@startmindmap\n* Bar\n@endmindmap\n";
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+class LayoutCalibratorTest : public ::testing::Test
+{
+protected:
+    // runs the event loop until the calibrator is done, false on timeout
+    bool calibrate(const QList<QByteArray>& samples)
+    {
+        QEventLoop loop;
+        QTimer::singleShot(WAIT_TIMEOUT, &loop, SLOT(quit()));
+        QObject::connect(&calibrator, SIGNAL(finished()), &loop, SLOT(quit()));
+        calibrator.start(fakeSettings(), samples);
+        if (calibrator.isRunning()) {
+            loop.exec();
+        }
+        return !calibrator.isRunning();
+    }
+
+    LayoutCalibrator calibrator;
+};
+
+//------------------------------------------------------------------------------
+
+TEST_F(LayoutCalibratorTest, testEveryKindGetsAnEngine) {
+    ASSERT_TRUE(calibrate(QList<QByteArray>() << CLASS_DIAGRAM << SEQUENCE_DIAGRAM));
+    EXPECT_EQ(2, calibrator.choices().size());
+    EXPECT_TRUE(calibrator.choices().contains("class"));
+    EXPECT_TRUE(calibrator.choices().contains("sequence"));
+}
+
+TEST_F(LayoutCalibratorTest, testKindNoEngineCanRenderGetsNoEngine) {
+    ASSERT_TRUE(calibrate(QList<QByteArray>() << CLASS_DIAGRAM << FAILING_DIAGRAM));
+    EXPECT_TRUE(calibrator.choices().contains("class"));
+    EXPECT_FALSE(calibrator.choices().contains("state"));
+}
+
+TEST_F(LayoutCalibratorTest, testDiagramsWithoutGraphvizAreSkipped) {
+    ASSERT_TRUE(calibrate(QList<QByteArray>() << MINDMAP_DIAGRAM));
+    EXPECT_TRUE(calibrator.choices().isEmpty());
+}
+
+TEST_F(LayoutCalibratorTest, testSmetanaIsChosenWithAPragma) {
+    EXPECT_EQ(QByteArray("@startuml\n!pragma layout smetana\nclass Foo\n@enduml\n"),
+              LayoutCalibrator::withEngine(CLASS_DIAGRAM, LayoutCalibrator::SmetanaEngine));
+    EXPECT_EQ(CLASS_DIAGRAM, LayoutCalibrator::withEngine(CLASS_DIAGRAM, LayoutCalibrator::GraphvizEngine));
+    EXPECT_EQ(MINDMAP_DIAGRAM, LayoutCalibrator::withEngine(MINDMAP_DIAGRAM, LayoutCalibrator::SmetanaEngine));
+}
@@ -1,5 +1,6 @@
 #include <QtCore/QString>
 #include <QtCore/QDate>
+#include <QtCore/QCoreApplication>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
@@ -9,6 +10,8 @@ void PrintTo(const QString& string, ::std::ostream* os) {
 
 int main(int argc, char** argv)
 {
+    // QProcess, the sockets and the timers of the tests need an event loop
+    QCoreApplication app(argc, argv);
     ::testing::InitGoogleMock(&argc, argv);
     return RUN_ALL_TESTS();
 }
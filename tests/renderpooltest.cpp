@@ -0,0 +1,97 @@
+#include "renderpool.h"
+#include "fakesettings.h"
+#include "jobrecorder.h"
+#include <QCoreApplication>
+#include <gmock/gmock.h>
+
+//------------------------------------------------------------------------------
+
+namespace {
+const QByteArray FOO_DIAGRAM = "@startuml\nclass Foo\n@enduml\n";
+const QByteArray BAR_DIAGRAM = "@startuml\nclass Bar\n@enduml\n";
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+class RenderPoolTest : public ::testing::Test
+{
+protected:
+    RenderPoolTest()
+        : pool(2)
+        , recorder(&pool)
+    {
+        pool.setSettings(fakeSettings());
+    }
+
+    RenderPool pool;
+    JobRecorder recorder;
+};
+
+//------------------------------------------------------------------------------
+
+TEST_F(RenderPoolTest, testIdenticalJobsAreRenderedOnce) {
+    RenderJob* first = new RenderJob("foo", FOO_DIAGRAM, "svg");
+    RenderJob* second = new RenderJob("foo", FOO_DIAGRAM, "svg");
+    pool.render(first);
+    pool.render(second);
+    EXPECT_TRUE(pool.isInFlight("foo"));
+    EXPECT_EQ(1, pool.waiterCount());
+    EXPECT_EQ(1, pool.busyCount());
+    ASSERT_TRUE(recorder.waitFor(2));
+
+    // the job that was rendered is finished first
+    EXPECT_EQ(first, recorder.jobs[0].job);
+    EXPECT_EQ(second, recorder.jobs[1].job);
+    EXPECT_EQ(RenderJob::Done, recorder.jobs[1].state);
+    EXPECT_EQ(recorder.jobs[0].output, recorder.jobs[1].output);
+    EXPECT_FALSE(pool.isInFlight("foo"));
+    EXPECT_EQ(0, pool.waiterCount());
+}
+
+TEST_F(RenderPoolTest, testDifferentJobsAreNotCoalesced) {
+    pool.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    pool.render(new RenderJob("bar", BAR_DIAGRAM, "svg"));
+    EXPECT_EQ(0, pool.waiterCount());
+    ASSERT_TRUE(recorder.waitFor(2));
+}
+
+TEST_F(RenderPoolTest, testWaiterIsRenderedWhenTheJobIsCancelled) {
+    RenderJob* first = new RenderJob("foo", FOO_DIAGRAM, "svg");
+    RenderJob* second = new RenderJob("foo", FOO_DIAGRAM, "svg");
+    pool.render(first);
+    pool.render(second);
+    EXPECT_TRUE(pool.cancel(first));
+    EXPECT_TRUE(pool.isInFlight("foo"));
+    EXPECT_EQ(0, pool.waiterCount());
+    ASSERT_TRUE(recorder.waitFor(1));
+
+    EXPECT_EQ(second, recorder.jobs[0].job);
+    EXPECT_EQ(RenderJob::Done, recorder.jobs[0].state);
+}
+
+TEST_F(RenderPoolTest, testCancelledWaiterIsNotFinished) {
+    RenderJob* second = new RenderJob("foo", FOO_DIAGRAM, "svg");
+    pool.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    pool.render(second);
+    EXPECT_TRUE(pool.cancel(second));
+    EXPECT_EQ(0, pool.waiterCount());
+    ASSERT_TRUE(recorder.waitFor(1));
+
+    QCoreApplication::processEvents();
+    EXPECT_EQ(1, recorder.jobs.size());
+}
+
+TEST_F(RenderPoolTest, testUrgentWaiterRaisesTheJobItWaitsFor) {
+    pool.setSize(1);
+    RenderJob* other = new RenderJob("bar", BAR_DIAGRAM, "svg");
+    RenderJob* first = new RenderJob("foo", FOO_DIAGRAM, "svg");
+    other->setPriority(RenderJob::BackgroundPriority);
+    first->setPriority(RenderJob::BackgroundPriority);
+    pool.render(other);
+    pool.render(first);
+    pool.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(3));
+
+    EXPECT_EQ(first, recorder.jobs[0].job);
+    EXPECT_EQ(QString("bar"), recorder.jobs[2].key);
+}
@@ -0,0 +1,291 @@
+#include "renderworker.h"
+#include "filecache.h"
+#include "fakesettings.h"
+#include "jobrecorder.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <gmock/gmock.h>
+
+//------------------------------------------------------------------------------
+
+namespace {
+const QByteArray FOO_DIAGRAM = "@startuml\nclass Foo\n@enduml\n";
+const QByteArray BAR_DIAGRAM = "@startuml\nclass Bar\n@enduml\n";
+const QByteArray ERROR_DIAGRAM = "@startuml\nerror\n@enduml\n";
+const QByteArray CRASH_DIAGRAM = "@startuml\ncrash\n@enduml\n";
+const QByteArray HANG_DIAGRAM = "@startuml\nhang\n@enduml\n";
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+class RenderWorkerTest : public ::testing::Test
+{
+protected:
+    RenderWorkerTest()
+        : recorder(&worker)
+    {
+        worker.setSettings(fakeSettings());
+    }
+
+    RenderWorker worker;
+    JobRecorder recorder;
+};
+
+//------------------------------------------------------------------------------
+
+TEST_F(RenderWorkerTest, testNewJobIsQueued) {
+    RenderJob job("foo", FOO_DIAGRAM, "svg");
+    EXPECT_EQ(RenderJob::Queued, job.state());
+    EXPECT_FALSE(job.isFinished());
+    EXPECT_EQ(0, job.attempts());
+}
+
+TEST_F(RenderWorkerTest, testJobIsQueuedUntilTheEventLoopRuns) {
+    RenderJob* job = new RenderJob("foo", FOO_DIAGRAM, "svg");
+    worker.render(job);
+    EXPECT_EQ(RenderJob::Queued, job->state());
+    EXPECT_TRUE(worker.isBusy());
+    EXPECT_FALSE(worker.isRunning());
+    ASSERT_TRUE(recorder.waitFor(1));
+}
+
+TEST_F(RenderWorkerTest, testJobIsDone) {
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(1));
+
+    EXPECT_EQ(QString("foo"), recorder.jobs[0].key);
+    EXPECT_EQ(RenderJob::Done, recorder.jobs[0].state);
+    EXPECT_EQ(QByteArray("svg\n") + FOO_DIAGRAM, recorder.jobs[0].output);
+    EXPECT_TRUE(recorder.jobs[0].errorString.isEmpty());
+    EXPECT_EQ(1, recorder.jobs[0].attempts);
+    EXPECT_FALSE(worker.isBusy());
+    EXPECT_TRUE(worker.isRunning());
+}
+
+TEST_F(RenderWorkerTest, testJobsAreDoneInOrder) {
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    worker.render(new RenderJob("bar", BAR_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(2));
+
+    EXPECT_EQ(QString("foo"), recorder.jobs[0].key);
+    EXPECT_EQ(QByteArray("svg\n") + FOO_DIAGRAM, recorder.jobs[0].output);
+    EXPECT_EQ(QString("bar"), recorder.jobs[1].key);
+    EXPECT_EQ(QByteArray("svg\n") + BAR_DIAGRAM, recorder.jobs[1].output);
+}
+
+TEST_F(RenderWorkerTest, testFormatChangeRestartsTheProcess) {
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    worker.render(new RenderJob("bar", BAR_DIAGRAM, "png"));
+    ASSERT_TRUE(recorder.waitFor(2));
+
+    EXPECT_EQ(QByteArray("svg\n") + FOO_DIAGRAM, recorder.jobs[0].output);
+    EXPECT_EQ(QByteArray("png\n") + BAR_DIAGRAM, recorder.jobs[1].output);
+    EXPECT_EQ(QString("png"), worker.processFormat());
+}
+
+TEST_F(RenderWorkerTest, testErrorFailsOnlyItsJob) {
+    worker.render(new RenderJob("error", ERROR_DIAGRAM, "svg"));
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(2));
+
+    EXPECT_EQ(RenderJob::Failed, recorder.jobs[0].state);
+    EXPECT_TRUE(recorder.jobs[0].errorString.startsWith("ERROR"));
+    EXPECT_TRUE(recorder.jobs[0].output.isEmpty());
+    EXPECT_EQ(RenderJob::Done, recorder.jobs[1].state);
+}
+
+TEST_F(RenderWorkerTest, testCrashingJobIsRetriedThenFailed) {
+    worker.render(new RenderJob("crash", CRASH_DIAGRAM, "svg"));
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(2));
+
+    EXPECT_EQ(QString("crash"), recorder.jobs[0].key);
+    EXPECT_EQ(RenderJob::Failed, recorder.jobs[0].state);
+    EXPECT_EQ(2, recorder.jobs[0].attempts);
+    EXPECT_FALSE(recorder.jobs[0].errorString.isEmpty());
+
+    // the worker doesn't get stuck after a crash, and the crash isn't held
+    // against the job batched behind it
+    EXPECT_EQ(QString("foo"), recorder.jobs[1].key);
+    EXPECT_EQ(RenderJob::Done, recorder.jobs[1].state);
+    EXPECT_EQ(1, recorder.jobs[1].attempts);
+}
+
+TEST_F(RenderWorkerTest, testHangingJobTimesOutWithoutRetry) {
+    worker.setTimeout(500);
+    worker.render(new RenderJob("hang", HANG_DIAGRAM, "svg"));
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(2));
+
+    EXPECT_EQ(QString("hang"), recorder.jobs[0].key);
+    EXPECT_EQ(RenderJob::Failed, recorder.jobs[0].state);
+    EXPECT_TRUE(recorder.jobs[0].timedOut);
+    EXPECT_EQ(1, recorder.jobs[0].attempts);
+    EXPECT_TRUE(recorder.jobs[0].errorString.contains("hanging on purpose"));
+
+    // the rest of the batch is rendered by a new process
+    EXPECT_EQ(QString("foo"), recorder.jobs[1].key);
+    EXPECT_EQ(RenderJob::Done, recorder.jobs[1].state);
+    EXPECT_FALSE(recorder.jobs[1].timedOut);
+}
+
+TEST_F(RenderWorkerTest, testManyJobsAreBatched) {
+    const int COUNT = 20;
+    for (int i = 0; i < COUNT; ++i) {
+        worker.render(new RenderJob(QString::number(i), i % 2 ? FOO_DIAGRAM : BAR_DIAGRAM, "svg"));
+    }
+    ASSERT_TRUE(recorder.waitFor(COUNT));
+
+    for (int i = 0; i < COUNT; ++i) {
+        EXPECT_EQ(QString::number(i), recorder.jobs[i].key);
+        EXPECT_EQ(QByteArray("svg\n") + (i % 2 ? FOO_DIAGRAM : BAR_DIAGRAM), recorder.jobs[i].output);
+    }
+}
+
+TEST_F(RenderWorkerTest, testProcessExitsAfterBatchWhenNotKeptRunning) {
+    worker.setKeepRunning(false);
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    worker.render(new RenderJob("bar", BAR_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(2));
+    EXPECT_EQ(RenderJob::Done, recorder.jobs[0].state);
+    EXPECT_EQ(RenderJob::Done, recorder.jobs[1].state);
+
+    // the next batch gets a new process
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(3));
+    EXPECT_EQ(RenderJob::Done, recorder.jobs[2].state);
+    EXPECT_EQ(1, recorder.jobs[2].attempts);
+}
+
+TEST_F(RenderWorkerTest, testMissingExecutableFailsQueuedJobs) {
+    RenderSettings settings = fakeSettings();
+    settings.javaPath = QCoreApplication::applicationDirPath() + "/no-such-java";
+    worker.setSettings(settings);
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    worker.render(new RenderJob("bar", BAR_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(2));
+
+    EXPECT_EQ(RenderJob::Failed, recorder.jobs[0].state);
+    EXPECT_EQ(RenderJob::Failed, recorder.jobs[1].state);
+    EXPECT_FALSE(worker.isBusy());
+
+    // and recovers once the settings are fixed
+    worker.setSettings(fakeSettings());
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(3));
+    EXPECT_EQ(RenderJob::Done, recorder.jobs[2].state);
+}
+
+TEST_F(RenderWorkerTest, testCancelledJobIsNotRendered) {
+    RenderJob* foo = new RenderJob("foo", FOO_DIAGRAM, "svg");
+    RenderJob* bar = new RenderJob("bar", BAR_DIAGRAM, "svg");
+    worker.render(foo);
+    worker.render(bar);
+    EXPECT_TRUE(worker.cancel(bar));
+    EXPECT_EQ(1, worker.queueSize());
+    ASSERT_TRUE(recorder.waitFor(1));
+
+    QCoreApplication::processEvents();
+    EXPECT_EQ(1, recorder.jobs.size());
+    EXPECT_FALSE(worker.isBusy());
+}
+
+TEST_F(RenderWorkerTest, testStopPutsJobBackInQueue) {
+    RenderJob* job = new RenderJob("foo", FOO_DIAGRAM, "svg");
+    worker.render(job);
+    worker.stop();
+    EXPECT_FALSE(worker.isRunning());
+    EXPECT_EQ(RenderJob::Queued, job->state());
+    EXPECT_EQ(1, worker.queueSize());
+
+    worker.render(new RenderJob("bar", BAR_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(2));
+    EXPECT_EQ(QString("foo"), recorder.jobs[0].key);
+    EXPECT_EQ(RenderJob::Done, recorder.jobs[0].state);
+}
+
+TEST_F(RenderWorkerTest, testInteractiveJobRunsBeforeBackgroundJobs) {
+    for (int i = 0; i < 3; ++i) {
+        RenderJob* job = new RenderJob(QString("background%1").arg(i), BAR_DIAGRAM, "svg");
+        job->setPriority(RenderJob::BackgroundPriority);
+        worker.render(job);
+    }
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(4));
+
+    EXPECT_EQ(QString("foo"), recorder.jobs[0].key);
+    // the background jobs keep their order
+    EXPECT_EQ(QString("background0"), recorder.jobs[1].key);
+    EXPECT_EQ(QString("background2"), recorder.jobs[3].key);
+}
+
+TEST_F(RenderWorkerTest, testStolenJobIsTheLastOfTheHighestPriority) {
+    RenderJob* background = new RenderJob("background", BAR_DIAGRAM, "svg");
+    background->setPriority(RenderJob::BackgroundPriority);
+    RenderJob* foo = new RenderJob("foo", FOO_DIAGRAM, "svg");
+    RenderJob* bar = new RenderJob("bar", BAR_DIAGRAM, "svg");
+    worker.render(background);
+    worker.render(foo);
+    worker.render(bar);
+
+    EXPECT_EQ(bar, worker.stealJob());
+    delete bar;
+    EXPECT_EQ(2, worker.queueSize());
+    EXPECT_EQ(1, worker.queueSize(RenderJob::InteractivePriority));
+    ASSERT_TRUE(recorder.waitFor(2));
+}
+
+TEST_F(RenderWorkerTest, testRaisedJobMovesAhead) {
+    RenderJob* first = new RenderJob("first", FOO_DIAGRAM, "svg");
+    RenderJob* second = new RenderJob("second", BAR_DIAGRAM, "svg");
+    first->setPriority(RenderJob::BackgroundPriority);
+    second->setPriority(RenderJob::BackgroundPriority);
+    worker.render(first);
+    worker.render(second);
+    EXPECT_TRUE(worker.raisePriority(second, RenderJob::InteractivePriority));
+    ASSERT_TRUE(recorder.waitFor(2));
+
+    EXPECT_EQ(QString("second"), recorder.jobs[0].key);
+    EXPECT_EQ(QString("first"), recorder.jobs[1].key);
+}
+
+TEST_F(RenderWorkerTest, testOutputIsWrittenToFile) {
+    const QString path = QDir::temp().absoluteFilePath("renderworkertest-output.svg");
+    RenderJob* job = new RenderJob("foo", FOO_DIAGRAM, "svg");
+    job->setOutputPath(path);
+    worker.render(job);
+    ASSERT_TRUE(recorder.waitFor(1));
+    ASSERT_EQ(RenderJob::Done, recorder.jobs[0].state);
+
+    worker.outputWriter()->flush(); // it's written in the background
+    QFile file(path);
+    ASSERT_TRUE(file.open(QIODevice::ReadOnly));
+    EXPECT_EQ(recorder.jobs[0].output, file.readAll());
+    file.remove();
+}
+
+TEST_F(RenderWorkerTest, testOutputFileIsRemovedOnError) {
+    const QString path = QDir::temp().absoluteFilePath("renderworkertest-error.svg");
+    RenderJob* job = new RenderJob("error", ERROR_DIAGRAM, "svg");
+    job->setOutputPath(path);
+    worker.render(job);
+    ASSERT_TRUE(recorder.waitFor(1));
+
+    EXPECT_EQ(RenderJob::Failed, recorder.jobs[0].state);
+    worker.outputWriter()->flush();
+    EXPECT_FALSE(QFile::exists(path));
+}
+
+TEST_F(RenderWorkerTest, testOutputLargerThanLimitFails) {
+    worker.setMaxOutputSize(FOO_DIAGRAM.size());
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(1));
+    EXPECT_EQ(RenderJob::Failed, recorder.jobs[0].state);
+    EXPECT_TRUE(recorder.jobs[0].output.isEmpty());
+
+    worker.setMaxOutputSize(0);
+    worker.render(new RenderJob("foo", FOO_DIAGRAM, "svg"));
+    ASSERT_TRUE(recorder.waitFor(2));
+    EXPECT_EQ(RenderJob::Done, recorder.jobs[1].state);
+}
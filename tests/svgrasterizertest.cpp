@@ -0,0 +1,97 @@
+#include "svgrasterizer.h"
+#include <QEventLoop>
+#include <QTimer>
+#include <QImage>
+#include <gmock/gmock.h>
+
+//------------------------------------------------------------------------------
+
+namespace {
+const int WAIT_TIMEOUT = 10000; // in miliseconds
+
+// no text, which would need the fonts of a GUI application
+const QByteArray SVG_IMAGE =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"40px\" height=\"20px\" viewBox=\"0 0 40 20\">"
+        "<rect x=\"5\" y=\"5\" width=\"30\" height=\"10\" fill=\"#FEFECE\" stroke=\"#A80036\"/>"
+        "</svg>";
+} // namespace {}
+
+//------------------------------------------------------------------------------
+
+class RasterRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RasterRecorder(SvgRasterizer* rasterizer)
+        : m_loop(0)
+    {
+        connect(rasterizer, SIGNAL(finished(QString,QByteArray)), this, SLOT(onFinished(QString,QByteArray)));
+    }
+
+    // runs the event loop until an image is done, false on timeout
+    bool wait()
+    {
+        if (key.isEmpty()) {
+            QEventLoop loop;
+            QTimer::singleShot(WAIT_TIMEOUT, &loop, SLOT(quit()));
+            m_loop = &loop;
+            loop.exec();
+            m_loop = 0;
+        }
+        return !key.isEmpty();
+    }
+
+    QString key;
+    QByteArray png;
+
+private slots:
+    void onFinished(const QString& finished_key, const QByteArray& finished_png)
+    {
+        key = finished_key;
+        png = finished_png;
+        if (m_loop) {
+            m_loop->quit();
+        }
+    }
+
+private:
+    QEventLoop* m_loop;
+};
+
+//------------------------------------------------------------------------------
+
+TEST(SvgRasterizer, testPngHasTheSizeOfTheSvg) {
+    QImage image;
+    ASSERT_TRUE(image.loadFromData(SvgRasterizer::toPng(SVG_IMAGE, 96), "PNG"));
+    EXPECT_EQ(40, image.width());
+    EXPECT_EQ(20, image.height());
+}
+
+TEST(SvgRasterizer, testPngIsScaledWithTheDpi) {
+    QImage image;
+    ASSERT_TRUE(image.loadFromData(SvgRasterizer::toPng(SVG_IMAGE, 192), "PNG"));
+    EXPECT_EQ(80, image.width());
+    EXPECT_EQ(40, image.height());
+}
+
+TEST(SvgRasterizer, testInvalidSvgGivesNoPng) {
+    EXPECT_TRUE(SvgRasterizer::toPng("ERROR\n1\nSyntax Error?", 96).isEmpty());
+}
+
+TEST(SvgRasterizer, testRasterizeInTheBackground) {
+    SvgRasterizer rasterizer;
+    RasterRecorder recorder(&rasterizer);
+    rasterizer.setDpi(48);
+    rasterizer.rasterize("foo.png", SVG_IMAGE);
+    ASSERT_TRUE(recorder.wait());
+
+    EXPECT_EQ(QString("foo.png"), recorder.key);
+    QImage image;
+    ASSERT_TRUE(image.loadFromData(recorder.png, "PNG"));
+    EXPECT_EQ(20, image.width());
+}
+
+//------------------------------------------------------------------------------
+
+#include "svgrasterizertest.moc"